@@ -0,0 +1,138 @@
+#pragma once
+#include <gfx.hpp>
+#include "spi_arbiter.hpp"
+// a draw target that forwards to a display on a shared SPI bus,
+// taking the bus from the arbiter for at most MaxPixels (rounded up
+// to whole rows) at a time
+template<typename Destination, size_t MaxPixels>
+class arbitrated_target final {
+    Destination& m_destination;
+    spi_arbiter& m_arbiter;
+    gfx::rect16 m_batch;
+    uint16_t m_batch_x;
+    uint16_t m_batch_y;
+    size_t m_batch_pixels;
+    bool m_batch_held;
+    void wait_destination() {
+        // don't hand the bus over with writes still in flight
+        if constexpr(Destination::caps::async) {
+            m_destination.wait_all_async();
+        }
+    }
+    template<typename Operation>
+    gfx::gfx_result banded(const gfx::rect16& rect, Operation op) {
+        const gfx::rect16 r = rect.normalize();
+        const size_t width = r.x2-r.x1+1;
+        size_t rows = MaxPixels/width;
+        if(rows==0) {
+            rows = 1;
+        }
+        for(size_t y = r.y1;y<=r.y2;y+=rows) {
+            size_t y2 = y+rows-1;
+            if(y2>r.y2) {
+                y2 = r.y2;
+            }
+            m_arbiter.bulk_acquire();
+            gfx::gfx_result res = op(gfx::rect16(r.x1,uint16_t(y),r.x2,uint16_t(y2)));
+            wait_destination();
+            m_arbiter.bulk_release();
+            if(res!=gfx::gfx_result::success) {
+                return res;
+            }
+        }
+        return gfx::gfx_result::success;
+    }
+    arbitrated_target(const arbitrated_target& rhs)=delete;
+    arbitrated_target& operator=(const arbitrated_target& rhs)=delete;
+public:
+    using type = arbitrated_target;
+    using pixel_type = typename Destination::pixel_type;
+    using caps = gfx::gfx_caps<false,false,true,false,false,Destination::caps::read,false>;
+    inline arbitrated_target(Destination& destination, spi_arbiter& arbiter) :
+        m_destination(destination),m_arbiter(arbiter),m_batch_x(0),m_batch_y(0),m_batch_pixels(0),m_batch_held(false) {}
+    inline gfx::size16 dimensions() const { return m_destination.dimensions(); }
+    inline gfx::rect16 bounds() const { return m_destination.bounds(); }
+    gfx::gfx_result point(gfx::point16 location, pixel_type color) {
+        m_arbiter.bulk_acquire();
+        gfx::gfx_result res = m_destination.point(location,color);
+        wait_destination();
+        m_arbiter.bulk_release();
+        return res;
+    }
+    gfx::gfx_result point(gfx::point16 location, pixel_type* out_color) const {
+        m_arbiter.bulk_acquire();
+        gfx::gfx_result res = m_destination.point(location,out_color);
+        m_arbiter.bulk_release();
+        return res;
+    }
+    gfx::gfx_result fill(const gfx::rect16& rect, pixel_type color) {
+        return banded(rect,[this,color](const gfx::rect16& band) {
+            return m_destination.fill(band,color);
+        });
+    }
+    gfx::gfx_result clear(const gfx::rect16& rect) {
+        return banded(rect,[this](const gfx::rect16& band) {
+            return m_destination.clear(band);
+        });
+    }
+    gfx::gfx_result begin_batch(const gfx::rect16& rect) {
+        m_batch = rect.normalize();
+        m_batch_x = m_batch.x1;
+        m_batch_y = m_batch.y1;
+        m_batch_pixels = 0;
+        m_arbiter.bulk_acquire();
+        m_batch_held = true;
+        gfx::gfx_result res = m_destination.begin_batch(m_batch);
+        if(res!=gfx::gfx_result::success) {
+            m_batch_held = false;
+            m_arbiter.bulk_release();
+        }
+        return res;
+    }
+    gfx::gfx_result write_batch(pixel_type color) {
+        if(!m_batch_held) {
+            return gfx::gfx_result::invalid_state;
+        }
+        gfx::gfx_result res = m_destination.write_batch(color);
+        if(res!=gfx::gfx_result::success) {
+            return res;
+        }
+        ++m_batch_pixels;
+        if(++m_batch_x<=m_batch.x2) {
+            return res;
+        }
+        m_batch_x = m_batch.x1;
+        ++m_batch_y;
+        if(m_batch_pixels<MaxPixels || m_batch_y>m_batch.y2) {
+            return res;
+        }
+        // at a row boundary past the chunk size. finish this part of
+        // the window, let the critical side in, and reopen the rest
+        res = m_destination.commit_batch();
+        wait_destination();
+        m_batch_held = false;
+        m_arbiter.bulk_release();
+        if(res!=gfx::gfx_result::success) {
+            return res;
+        }
+        m_batch_pixels = 0;
+        m_arbiter.bulk_acquire();
+        m_batch_held = true;
+        res = m_destination.begin_batch(gfx::rect16(m_batch.x1,m_batch_y,m_batch.x2,m_batch.y2));
+        if(res!=gfx::gfx_result::success) {
+            m_batch_held = false;
+            m_arbiter.bulk_release();
+        }
+        return res;
+    }
+    gfx::gfx_result commit_batch() {
+        if(!m_batch_held) {
+            return gfx::gfx_result::invalid_state;
+        }
+        gfx::gfx_result res = m_destination.commit_batch();
+        wait_destination();
+        m_batch_held = false;
+        m_arbiter.bulk_release();
+        return res;
+    }
+};
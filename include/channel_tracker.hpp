@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_context.hpp"
+#include "midi_bulk_output.hpp"
+// tracks the state of each channel and what differs from a baseline
+class channel_tracker final {
+    struct dirty_bits {
+        uint64_t control[2];
+        uint64_t key_pressure[2];
+        uint8_t flags;
+    };
+    midi_context m_state;
+    dirty_bits m_dirty[16];
+    const midi_context* m_baseline;
+    uint8_t baseline_control(uint8_t channel, uint8_t control) const;
+    uint8_t baseline_key_pressure(uint8_t channel, uint8_t note) const;
+    uint8_t baseline_pressure(uint8_t channel) const;
+    int16_t baseline_pitch(uint8_t channel) const;
+    uint8_t baseline_program(uint8_t channel) const;
+public:
+    // how many messages are handed to the output at once
+    constexpr static const size_t batch_size = 32;
+    channel_tracker();
+    // fills a context with power on defaults
+    static void defaults(midi_context* out_context);
+    inline const midi_context& state() const { return m_state; }
+    inline const midi_context* baseline() const { return m_baseline; }
+    // sets the state reset() returns to. nullptr uses the defaults.
+    // the context must outlive the tracker
+    void baseline(const midi_context* value);
+    // sets the state to the baseline without sending anything
+    void clear();
+    void process(const sfx::midi_message& message);
+    // the channels that differ from the baseline
+    uint16_t dirty() const;
+    // sends only the messages needed to return the given channels to the baseline
+    sfx::sfx_result reset(uint16_t channels, midi_bulk_output& output);
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+// what a key does to its track
+enum struct key_action : uint8_t {
+    none = 0,
+    // press starts (or restarts) the track
+    start,
+    // press stops the track
+    stop,
+    // press starts the track if it's stopped, otherwise stops it
+    toggle,
+    // press starts the track, release stops it
+    momentary,
+    // press mutes or unmutes the track
+    mute
+};
+struct key_binding {
+    key_action action;
+    uint8_t track;
+};
+// maps every channel and note to a track action
+class key_map final {
+    key_binding m_bindings[16][128];
+public:
+    key_map();
+    void clear();
+    inline const key_binding& lookup(uint8_t channel, uint8_t note) const {
+        return m_bindings[channel&0x0F][note&0x7F];
+    }
+    // binds count consecutive notes to consecutive tracks starting at track
+    sfx::sfx_result set(uint8_t channel, uint8_t note, key_action action, size_t track, size_t count = 1);
+    // reads a map, one binding per line:
+    //   channel note action track [count]
+    // channel is 1-16 and track is 1 based, like /prang.trk. action is
+    // s(tart), x (stop), t(oggle), m(omentary) or u (mute). count binds
+    // a run of notes to a run of tracks.
+    // blank lines and anything after # are ignored
+    static sfx::sfx_result read(sfx::stream& stream, key_map* out_map);
+};
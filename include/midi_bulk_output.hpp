@@ -0,0 +1,26 @@
+#pragma once
+#include <sfx_midi_core.hpp>
+// a MIDI output that can take several messages in one call
+class midi_bulk_output : public sfx::midi_output {
+public:
+    using sfx::midi_output::send;
+    // sends several messages. the default sends them one at a time
+    virtual sfx::sfx_result send(const sfx::midi_message* messages, size_t count) {
+        for(size_t i = 0;i<count;++i) {
+            sfx::sfx_result r = send(messages[i]);
+            if(r!=sfx::sfx_result::success) {
+                return r;
+            }
+        }
+        return sfx::sfx_result::success;
+    }
+    // sends a message that was due at a midi_stats::now() timestamp.
+    // the default doesn't order by time and just sends it
+    virtual sfx::sfx_result send_at(const sfx::midi_message& message, uint32_t) {
+        return send(message);
+    }
+    // writes anything the output is holding back. the default holds nothing
+    virtual sfx::sfx_result flush() {
+        return sfx::sfx_result::success;
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
+// holds messages back a fixed time before passing them on, to line an
+// output up with slower ones. nothing waits: messages are stamped with
+// when they're due and leave from flush(), so call it every pass.
+// not thread safe
+class midi_delay final : public midi_bulk_output {
+public:
+    constexpr static const size_t capacity = 256;
+    // room for the sysex waiting, in bytes
+    constexpr static const size_t sysex_capacity = 1024;
+private:
+    struct entry {
+        uint32_t due;
+        uint8_t status;
+        uint8_t data[2];
+        uint16_t sysex_offset;
+        uint16_t sysex_size;
+    };
+    midi_bulk_output* m_output;
+    uint32_t m_delay;
+    entry m_entries[capacity];
+    size_t m_head;
+    size_t m_size;
+    uint8_t m_sysex[sysex_capacity];
+    size_t m_sysex_head;
+    size_t m_sysex_tail;
+    size_t m_sysex_count;
+    size_t m_overruns;
+    bool allocate_sysex(size_t size, size_t* out_offset);
+    sfx::sfx_result forward(const entry& e);
+    midi_delay(const midi_delay& rhs)=delete;
+    midi_delay& operator=(const midi_delay& rhs)=delete;
+public:
+    midi_delay(midi_bulk_output* output = nullptr);
+    inline midi_bulk_output* output() const { return m_output; }
+    void output(midi_bulk_output* value);
+    // the delay in microseconds. a change applies to what's sent after it
+    inline uint32_t delay() const { return m_delay; }
+    inline void delay(uint32_t value) { m_delay = value; }
+    // discards everything waiting
+    void clear();
+    inline size_t pending() const { return m_size; }
+    // messages turned away because the queue was full
+    inline size_t overruns() const { return m_overruns; }
+    // returns device_error if there isn't room for it
+    virtual sfx::sfx_result send(const sfx::midi_message& message);
+    // passes on what's due, then flushes the output
+    virtual sfx::sfx_result flush();
+};
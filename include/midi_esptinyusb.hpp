@@ -1,10 +1,26 @@
 #pragma once
 #include <sfx_midi_core.hpp>
+#include "midi_bulk_output.hpp"
 namespace arduino {
-    class midi_esptinyusb final : public sfx::midi_output {
+    // sends to the USB device port. messages are packed into USB-MIDI
+    // event packets and held until flush(), or until the buffer fills
+    class midi_esptinyusb final : public midi_bulk_output {
     public:
+        // one full speed bulk packet's worth
+        constexpr static const size_t max_packets = 16;
+    private:
+        uint8_t m_packets[max_packets*4];
+        size_t m_packets_size;
+        sfx::sfx_result write_packet(uint8_t cin, uint8_t b0, uint8_t b1, uint8_t b2);
+        sfx::sfx_result write_sysex(const sfx::midi_message& message);
+    public:
+        midi_esptinyusb();
         sfx::sfx_result initialize(const char* device_name = nullptr);
         inline bool initialized() const;
         virtual sfx::sfx_result send(const sfx::midi_message& message);
+        virtual sfx::sfx_result send(const sfx::midi_message* messages, size_t count);
+        // queues a raw event packet. the cable number is used as is
+        sfx::sfx_result send_packet(const uint8_t* packet);
+        virtual sfx::sfx_result flush();
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
+#include "midi_router.hpp"
+// merges several sources into a router in the order their messages were
+// due rather than the order they were handed over. messages collect
+// until flush() and then leave sorted by timestamp, ties in arrival
+// order. a message never passes an earlier one from the same source on
+// the same channel, whatever their stamps say. the clock is passed in,
+// so it runs off the device too. not thread safe
+class midi_merger final {
+public:
+    constexpr static const size_t capacity = 256;
+    constexpr static const size_t max_sources = midi_router::max_sources;
+    // the messages from one source. plain sends are stamped with the clock
+    class input final : public midi_bulk_output {
+        friend class midi_merger;
+        midi_merger* m_merger;
+        size_t m_index;
+    public:
+        inline input() : m_merger(nullptr),m_index(0) {}
+        inline size_t index() const { return m_index; }
+        virtual sfx::sfx_result send(const sfx::midi_message& message);
+        virtual sfx::sfx_result send_at(const sfx::midi_message& message, uint32_t timestamp);
+        virtual sfx::sfx_result flush();
+    };
+private:
+    struct entry {
+        uint32_t timestamp;
+        uint8_t source;
+        uint8_t status;
+        uint8_t data[2];
+    };
+    midi_router* m_router;
+    uint32_t (*m_clock)();
+    entry m_entries[capacity];
+    size_t m_size;
+    input m_inputs[max_sources];
+    sfx::sfx_result queue(size_t source, const sfx::midi_message& message, uint32_t timestamp);
+    midi_merger(const midi_merger& rhs)=delete;
+    midi_merger& operator=(const midi_merger& rhs)=delete;
+public:
+    midi_merger(midi_router* router, uint32_t (*clock)());
+    // the output for a source. the index is the router source it goes to
+    midi_bulk_output& source(size_t index);
+    inline size_t pending() const { return m_size; }
+    // hands everything waiting to the router in order
+    sfx::sfx_result drain();
+    // drains, then flushes the router
+    sfx::sfx_result flush();
+};
@@ -9,6 +9,7 @@ enum struct midi_quantizer_timing {
 };
 class midi_quantizer final {
     midi_sampler* m_sampler;
+    midi_stats* m_stats;
     size_t m_quantize_beats;
     size_t m_follow_key;
     long* m_key_advance;
@@ -19,7 +20,7 @@ class midi_quantizer final {
     midi_quantizer(const midi_quantizer& rhs)=delete;
     midi_quantizer& operator=(const midi_quantizer& rhs)=delete;
 public:
-    inline midi_quantizer() : m_sampler(nullptr),m_key_advance(nullptr),m_deallocator(nullptr) {}
+    inline midi_quantizer() : m_sampler(nullptr),m_stats(nullptr),m_key_advance(nullptr),m_deallocator(nullptr) {}
     midi_quantizer(midi_quantizer&& rhs);
     midi_quantizer& operator=(midi_quantizer&& rhs);
     inline ~midi_quantizer() { deallocate(); }
@@ -28,7 +29,10 @@ public:
     inline unsigned long long last_key_ticks() const { return m_last_key_ticks;}
     inline midi_quantizer_timing last_timing() const { return m_last_timing;}
     void quantize_beats(int value);
-    sfx::sfx_result start(size_t index);
+    inline midi_stats* stats() const { return m_stats; }
+    inline void stats(midi_stats* value) { m_stats = value; }
+    // timestamp is when the key arrived, from midi_stats::now(). zero is now
+    sfx::sfx_result start(size_t index, uint32_t timestamp = 0);
     sfx::sfx_result stop(size_t index);
     static sfx::sfx_result create(midi_sampler& sampler,midi_quantizer* out_quantizer, void*(*allocator)(size_t)=::malloc,void(*deallocator)(void*)=::free);
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
+// fans messages out to several outputs, each with its own filter on
+// where a message came from and which channel it's on. the outputs are
+// expected to queue rather than wait, so one that falls behind only
+// holds up itself. note offs follow their note ons wherever they went,
+// even if the filters have changed since. an All Notes Off or All Sound
+// Off from anything but thru leaves the notes thru is holding alone,
+// and turns into note offs for the rest where it would cut them off.
+// not thread safe
+class midi_router final : public midi_bulk_output {
+public:
+    constexpr static const size_t max_destinations = 4;
+    // sources past max_sources-1 share the last bit
+    constexpr static const size_t max_sources = 64;
+    // the source thru traffic uses by convention
+    constexpr static const size_t thru_source = max_sources-1;
+    // the messages from one source
+    class input final : public midi_bulk_output {
+        friend class midi_router;
+        midi_router* m_router;
+        size_t m_index;
+    public:
+        inline input() : m_router(nullptr),m_index(0) {}
+        inline size_t index() const { return m_index; }
+        virtual sfx::sfx_result send(const sfx::midi_message& message);
+        virtual sfx::sfx_result flush();
+    };
+private:
+    struct destination {
+        midi_bulk_output* output;
+        uint64_t sources;
+        uint16_t channels;
+        // the notes sounding on it
+        uint64_t notes[16][2];
+        // the ones thru put there
+        uint64_t held[16][2];
+    };
+    destination m_destinations[max_destinations];
+    size_t m_destinations_size;
+    input m_inputs[max_sources];
+    sfx::sfx_result route(uint64_t source_bit, const sfx::midi_message& message);
+    static sfx::sfx_result release(destination& d, uint8_t channel);
+    midi_router(const midi_router& rhs)=delete;
+    midi_router& operator=(const midi_router& rhs)=delete;
+public:
+    midi_router();
+    // adds an output. returns its index, or -1 if there's no room
+    int add(midi_bulk_output* output, uint64_t sources = ~uint64_t(0), uint16_t channels = 0xFFFF);
+    inline size_t size() const { return m_destinations_size; }
+    // sets which sources (a bit for each) and channels reach an output
+    sfx::sfx_result filter(size_t index, uint64_t sources, uint16_t channels);
+    // the output for a source, such as a track
+    midi_bulk_output& source(size_t index);
+    // sends to every output whose channels match, whatever the source
+    virtual sfx::sfx_result send(const sfx::midi_message& message);
+    // flushes every output
+    virtual sfx::sfx_result flush();
+};
@@ -2,25 +2,40 @@
 #include <string.h>
 #include <sfx_midi_core.hpp>
 #include <sfx_midi_clock.hpp>
-#include "note_tracker.hpp"
+#include "voice_table.hpp"
+#include "channel_tracker.hpp"
+#include "midi_stats.hpp"
+#include "track_transform.hpp"
 class midi_sampler final {
     struct track {
         sfx::midi_clock clock;
         sfx::midi_event_ex event;
-        note_tracker tracker;
+        voice_table* voices;
+        channel_tracker* channels;
+        // the channels this track has sent on since it started
+        uint16_t touched;
+        // keeps time but sends no notes
+        bool muted;
+        track_transform transform;
         int32_t base_microtempo;
         float tempo_multiplier;
+        int32_t fixed_microtempo;
         unsigned long long delay;
         uint8_t* buffer;
         size_t buffer_size;
         size_t buffer_position;
-        sfx::midi_output* output;
+        midi_bulk_output* output;
+        midi_stats* stats;
+        size_t index;
     };
     void* (*m_allocator)(size_t);
     void (*m_deallocator)(void*);
     size_t m_tracks_size;
     track* m_tracks;
+    voice_table* m_voices;
+    channel_tracker* m_channels;
 
+    static int32_t effective_microtempo(const track& t);
     static void callback(uint32_t pending,unsigned long long elapsed, void* state);
     void deallocate();
     midi_sampler(const midi_sampler& rhs)=delete;
@@ -31,13 +46,35 @@ public:
     midi_sampler& operator=(midi_sampler&& rhs);
     ~midi_sampler();
     sfx::sfx_result update();
-    void output(sfx::midi_output* value);
+    void output(midi_bulk_output* value);
+    // sets one track's output
+    void output(size_t index, midi_bulk_output* value);
+    // see voice_table::all_notes_off_threshold()
+    void all_notes_off_threshold(size_t value);
+    // the state stopped tracks return their channels to. nullptr uses the defaults
+    void channel_baseline(const midi_context* value);
+    void stats(midi_stats* value);
     int16_t timebase(size_t index) const;
     unsigned long long elapsed(size_t index) const;
+    // the ticks a track had elapsed at an earlier midi_stats::now() timestamp
+    unsigned long long elapsed(size_t index, uint32_t timestamp) const;
+    int32_t microtempo(size_t index) const;
     inline size_t tracks_count() const { return m_tracks_size; }
     sfx::sfx_result start(size_t index,long long advance = 0);
     bool started(size_t index) const;
     sfx::sfx_result stop(size_t index);
+    bool muted(size_t index) const;
+    // silences a track's notes without stopping it
+    sfx::sfx_result mute(size_t index, bool value);
+    // reshapes what a track plays. its sounding notes are released
+    sfx::sfx_result transform(size_t index, const track_transform::settings& value);
+    const track_transform::settings* transform(size_t index) const;
+    // scales a track's note on velocities by velocity/127
+    sfx::sfx_result dynamics(size_t index, uint8_t velocity);
     void tempo_multiplier(float value);
+    // overrides the file tempo (and multiplier) for all tracks. zero reverts
+    void fixed_microtempo(int32_t value);
+    // returns out_of_memory for a file with more tracks than
+    // voice_table::max_owners, since their notes can't be told apart
     static sfx::sfx_result read(sfx::stream& stream,midi_sampler* out_sampler,void*(allocator)(size_t)=::malloc,void(deallocator)(void*)=::free);
 };
\ No newline at end of file
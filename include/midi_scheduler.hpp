@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
+// sits in front of an output that can push back. messages pass straight
+// through until the output refuses one, then wait here and leave by
+// priority: real time first, then notes and everything else that must
+// stay in order, then continuous controllers. a controller value still
+// waiting is replaced by a newer one for the same controller, and goes
+// out ahead of anything on its channel that was queued after it.
+// not thread safe
+class midi_scheduler final : public midi_bulk_output {
+public:
+    constexpr static const size_t realtime_capacity = 16;
+    constexpr static const size_t ordered_capacity = 128;
+    constexpr static const size_t continuous_capacity = 64;
+private:
+    struct short_message {
+        uint8_t status;
+        uint8_t data[2];
+        // when it was queued, relative to the other queue
+        uint32_t order;
+    };
+    midi_bulk_output* m_output;
+    uint8_t m_realtime[realtime_capacity];
+    size_t m_realtime_size;
+    short_message m_ordered[ordered_capacity];
+    size_t m_ordered_size;
+    short_message m_continuous[continuous_capacity];
+    size_t m_continuous_size;
+    uint32_t m_order;
+    size_t m_thinned;
+    size_t m_overruns;
+    size_t m_promoted;
+    sfx::sfx_result forward(const short_message& message);
+    sfx::sfx_result drain();
+    bool ordered_after(uint8_t status, uint32_t order) const;
+    bool continuous_before(uint8_t status) const;
+    sfx::sfx_result release(const short_message& message);
+    static void remove(short_message* messages, size_t* size, size_t index);
+    midi_scheduler(const midi_scheduler& rhs)=delete;
+    midi_scheduler& operator=(const midi_scheduler& rhs)=delete;
+public:
+    midi_scheduler(midi_bulk_output* output = nullptr);
+    inline midi_bulk_output* output() const { return m_output; }
+    void output(midi_bulk_output* value);
+    // discards everything waiting
+    void clear();
+    // messages waiting for the output
+    inline size_t pending() const { return m_realtime_size+m_ordered_size+m_continuous_size; }
+    // controller values replaced by newer ones before they went out
+    inline size_t thinned() const { return m_thinned; }
+    // messages turned away because their queue was full
+    inline size_t overruns() const { return m_overruns; }
+    // note offs sent ahead of messages queued before them
+    inline size_t promoted() const { return m_promoted; }
+    inline void clear_counters() { m_thinned = 0; m_overruns = 0; m_promoted = 0; }
+    // returns device_error if the message had to be turned away
+    virtual sfx::sfx_result send(const sfx::midi_message& message);
+    // sends what the output will take, then flushes the output
+    virtual sfx::sfx_result flush();
+};
@@ -4,58 +4,172 @@
 #error "This library requires the Arduino framework"
 #endif
 #include <sfx.hpp>
+#include "midi_bulk_output.hpp"
 namespace arduino {
-    template<typename SerialType = HardwareSerial>
-    class midi_serial_output final : public sfx::midi_output {
+    // sends to a DIN port without blocking. messages are queued whole
+    // in a ring buffer that flush() drains into the UART's own buffer
+    // as fast as it takes them. not thread safe
+    template<typename SerialType = HardwareSerial, size_t BufferSize = 2048>
+    class midi_serial_output final : public midi_bulk_output {
         SerialType& m_stream;
+        uint8_t m_buffer[BufferSize];
+        size_t m_head;
+        size_t m_tail;
+        size_t m_size;
+        uint8_t m_running_status;
+        bool m_running_status_enabled;
+        size_t m_overruns;
+        size_t m_saved;
+        size_t m_backlog;
+        // the most room the UART has reported, taken as its whole buffer
+        int m_uart_size;
+        void put(uint8_t value) {
+            m_buffer[m_head]=value;
+            if(++m_head==BufferSize) {
+                m_head = 0;
+            }
+            ++m_size;
+        }
+        // queues a short message, leaving the status out when it's running
+        sfx::sfx_result queue(uint8_t status, size_t data_size, uint8_t d1, uint8_t d2) {
+            const bool running = m_running_status_enabled && status==m_running_status;
+            const size_t size = data_size+(running?0:1);
+            if(BufferSize-m_size<size) {
+                ++m_overruns;
+                return sfx::sfx_result::device_error;
+            }
+            if(m_size+size>m_backlog) {
+                // not lost, just not ours to take yet
+                return sfx::sfx_result::device_error;
+            }
+            if(running) {
+                ++m_saved;
+            } else {
+                put(status);
+            }
+            if(data_size>0) {
+                put(d1);
+            }
+            if(data_size>1) {
+                put(d2);
+            }
+            if(status<0xF0) {
+                m_running_status = status;
+            } else if(status<0xF8) {
+                // system common cancels it. real time leaves it alone
+                m_running_status = 0;
+            }
+            return sfx::sfx_result::success;
+        }
     public:
         constexpr static const unsigned long baud_rate = 31250;
-        inline midi_serial_output(SerialType& serial) : m_stream(serial) {
+        constexpr static const size_t buffer_size = BufferSize;
+        inline midi_serial_output(SerialType& serial) : m_stream(serial),m_head(0),m_tail(0),m_size(0),m_running_status(0),m_running_status_enabled(true),m_overruns(0),m_saved(0),m_backlog(BufferSize),m_uart_size(0) {
         }
-        inline void initialize() {
-            m_stream.begin(baud_rate);
+        // -1 leaves a pin on the UART's default
+        inline void initialize(int8_t rx_pin = -1, int8_t tx_pin = -1) {
+            m_stream.begin(baud_rate,SERIAL_8N1,rx_pin,tx_pin);
+            m_running_status = 0;
         }
         inline bool initialized() const {
             return m_stream.baudRate()==baud_rate;
         }
+        // whether to leave out repeated channel status bytes.
+        // note offs are sent as note ons with zero velocity while it's on
+        inline bool running_status() const { return m_running_status_enabled; }
+        inline void running_status(bool value) { m_running_status_enabled = value; m_running_status = 0; }
+        // the bytes waiting to go out
+        inline size_t pending() const { return m_size; }
+        // the room left in the buffer
+        inline size_t available() const { return BufferSize-m_size; }
+        // messages turned away because the buffer was full
+        inline size_t overruns() const { return m_overruns; }
+        // status bytes running status has left out
+        inline size_t saved() const { return m_saved; }
+        inline void clear_counters() { m_overruns = 0; m_saved = 0; }
+        // the most bytes of short messages let wait, here and again in
+        // the UART. past it they're refused without counting an overrun,
+        // so a midi_scheduler in front holds and reorders them instead.
+        // sysex can still fill the whole buffer
+        inline size_t backlog() const { return m_backlog; }
+        inline void backlog(size_t value) { m_backlog = value<3?3:value; }
+        // queues a message. returns device_error if there isn't room
+        // for all of it yet, and out_of_memory if there never will be
         virtual sfx::sfx_result send(const sfx::midi_message& message) {
-            if(!m_stream.availableForWrite()) {
-                return sfx::sfx_result::device_error;
-            }
-            uint8_t buf[3];
             if(message.type()==sfx::midi_message_type::meta_event && 
                     (message.meta.type!=0 || message.meta.data!=nullptr)) {
                 return sfx::sfx_result::success;
             }
             if (message.type()==sfx::midi_message_type::system_exclusive) {
-                m_stream.write(message.status);
-                if(message.sysex.size) {
-                    m_stream.write(message.sysex.data,message.sysex.size);
+                const uint8_t* data = message.sysex.data;
+                const size_t size = data==nullptr?0:message.sysex.size;
+                const bool end = !(size && data[size-1]==0xF7);
+                const size_t total = 1+size+(end?1:0);
+                if(total>BufferSize) {
+                    ++m_overruns;
+                    return sfx::sfx_result::out_of_memory;
                 }
-                m_stream.write(0xF7);
-            } else {
-                // send a regular message
-                // build a buffer and send it using raw midi
-                buf[0] = message.status;
-                switch (message.wire_size()) {
-                    case 1:
-                        m_stream.write(buf[0]);
-                        break;
-                    case 2:
-                        buf[1] = message.value8;
-                        m_stream.write(buf[0]);
-                        m_stream.write(buf[1]);
-                        break;
-                    case 3:
-                        buf[1] = message.msb();
-                        buf[2] = message.lsb();
-                        m_stream.write(buf[0]);
-                        m_stream.write(buf[1]);
-                        m_stream.write(buf[2]);
-                        break;
-                    default:
-                        break;
-                } 
+                if(BufferSize-m_size<total) {
+                    ++m_overruns;
+                    return sfx::sfx_result::device_error;
+                }
+                put(message.status);
+                for(size_t i = 0;i<size;++i) {
+                    put(data[i]);
+                }
+                if(end) {
+                    put(0xF7);
+                }
+                m_running_status = 0;
+                return sfx::sfx_result::success;
+            }
+            switch (message.wire_size()) {
+                case 1:
+                    return queue(message.status,0,0,0);
+                case 2:
+                    return queue(message.status,1,message.value8,0);
+                case 3:
+                    if(m_running_status_enabled && 
+                            message.type()==sfx::midi_message_type::note_off) {
+                        // so it can run on from the note ons
+                        return queue(uint8_t(0x90|message.channel()),2,message.msb(),0);
+                    }
+                    return queue(message.status,2,message.msb(),message.lsb());
+                default:
+                    return sfx::sfx_result::success;
+            }
+        }
+        // hands as much of the buffer to the UART as it will take
+        // without waiting. call it often enough to keep the wire busy
+        virtual sfx::sfx_result flush() {
+            while(m_size) {
+                int room = m_stream.availableForWrite();
+                if(room>m_uart_size) {
+                    m_uart_size = room;
+                }
+                if((size_t)m_uart_size>m_backlog) {
+                    // keep the UART from hiding more than the backlog
+                    room-=m_uart_size-(int)m_backlog;
+                }
+                if(room<=0) {
+                    break;
+                }
+                size_t chunk = BufferSize-m_tail;
+                if(chunk>m_size) {
+                    chunk = m_size;
+                }
+                if(chunk>(size_t)room) {
+                    chunk = (size_t)room;
+                }
+                const size_t written = m_stream.write(m_buffer+m_tail,chunk);
+                if(written==0) {
+                    return sfx::sfx_result::io_error;
+                }
+                m_tail+=written;
+                if(m_tail==BufferSize) {
+                    m_tail = 0;
+                }
+                m_size-=written;
             }
             return sfx::sfx_result::success;
         }
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <sfx_midi_core.hpp>
+// a histogram over the most recent window of samples. min, max and
+// mean cover the same window. only total() counts every sample
+class midi_histogram final {
+public:
+    constexpr static const size_t bins = 32;
+    constexpr static const size_t window = 128;
+private:
+    int32_t m_low;
+    int32_t m_width;
+    // [0] is underflow, [bins+1] is overflow
+    uint16_t m_counts[bins+2];
+    int32_t m_samples[window];
+    size_t m_position;
+    size_t m_size;
+    uint32_t m_total;
+    int64_t m_sum;
+    size_t bin(int32_t value) const;
+public:
+    midi_histogram();
+    void initialize(int32_t low, int32_t width);
+    void clear();
+    void add(int32_t value);
+    inline int32_t low() const { return m_low; }
+    inline int32_t width() const { return m_width; }
+    inline uint16_t count(size_t index) const { return m_counts[index]; }
+    inline size_t size() const { return m_size; }
+    inline uint32_t total() const { return m_total; }
+    int32_t min() const;
+    int32_t max() const;
+    inline int32_t mean() const { return m_size?(int32_t)(m_sum/(int64_t)m_size):0; }
+    sfx::sfx_result write_text(sfx::stream& stream, const char* name) const;
+    sfx::sfx_result write_binary(sfx::stream& stream) const;
+};
+// collects timing statistics from the quantizer and sampler
+class midi_stats final {
+    struct track_latency {
+        uint32_t pending;
+        uint32_t last;
+        uint32_t min;
+        uint32_t max;
+        uint32_t count;
+        uint64_t sum;
+    };
+    midi_histogram m_offset_ticks;
+    midi_histogram m_offset_usecs;
+    midi_histogram m_lateness;
+    midi_histogram m_latency;
+    midi_histogram m_bus_wait;
+    uint32_t m_early;
+    uint32_t m_exact;
+    uint32_t m_late;
+    track_latency* m_tracks;
+    size_t m_tracks_size;
+    void(*m_deallocator)(void*);
+    void deallocate();
+    midi_stats(const midi_stats& rhs)=delete;
+    midi_stats& operator=(const midi_stats& rhs)=delete;
+public:
+    inline midi_stats() : m_tracks(nullptr),m_tracks_size(0),m_deallocator(nullptr) {}
+    midi_stats(midi_stats&& rhs);
+    midi_stats& operator=(midi_stats&& rhs);
+    inline ~midi_stats() { deallocate(); }
+    // the current time in microseconds
+    static uint32_t now();
+    inline const midi_histogram& offset_ticks() const { return m_offset_ticks; }
+    inline const midi_histogram& offset_usecs() const { return m_offset_usecs; }
+    inline const midi_histogram& lateness() const { return m_lateness; }
+    inline const midi_histogram& latency() const { return m_latency; }
+    inline const midi_histogram& bus_wait() const { return m_bus_wait; }
+    inline size_t tracks_count() const { return m_tracks_size; }
+    // reports a quantized hit. negative is early, positive is late
+    void hit(int32_t offset_ticks, int32_t offset_usecs);
+    // reports a trigger key received for a track
+    void key(size_t index, uint32_t timestamp);
+    // reports a note sent from a track
+    void note(size_t index, uint32_t timestamp);
+    // reports how late an event went out relative to when it was due
+    void lateness(uint32_t usecs);
+    // reports how long the USB host waited for the shared SPI bus
+    void bus_wait(uint32_t usecs);
+    void clear();
+    // copies the figures from another created for as many tracks, so
+    // they can be written out while the original carries on
+    sfx::sfx_result copy(const midi_stats& rhs);
+    sfx::sfx_result write_text(sfx::stream& stream) const;
+    sfx::sfx_result write_binary(sfx::stream& stream) const;
+    static sfx::sfx_result create(size_t tracks_count, int32_t tick_span, int32_t usec_span, midi_stats* out_stats, void*(*allocator)(size_t)=::malloc,void(*deallocator)(void*)=::free);
+};
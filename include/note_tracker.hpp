@@ -2,13 +2,21 @@
 #include <stdint.h>
 #include <sfx_midi_core.hpp>
 #include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
 class note_tracker final {
-    struct {
-        uint64_t low;
-        uint64_t high;
-    } m_notes[16];
+    // two 64-bit words of notes per channel
+    uint64_t m_notes[16][2];
 public:
+    // how many note offs are handed to the output at once
+    constexpr static const size_t batch_size = 32;
     note_tracker();
+    void clear();
     void process(const sfx::midi_message& message);
-    void send_off(sfx::midi_output& output);
-};
\ No newline at end of file
+    void set(uint8_t channel, uint8_t note);
+    void reset(uint8_t channel, uint8_t note);
+    size_t count(uint8_t channel) const;
+    // sends note offs for every tracked note and clears them. a channel 
+    // in all_notes_off_channels holding at least all_notes_off_threshold
+    // notes gets one All Notes Off (CC 123) instead. zero disables that
+    sfx::sfx_result send_off(midi_bulk_output& output, size_t all_notes_off_threshold = 0, uint16_t all_notes_off_channels = 0xFFFF);
+};
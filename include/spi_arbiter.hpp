@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+// shares one SPI host between a latency critical user (the USB host)
+// and a bulk user (the display). the bulk side works in bounded chunks
+// and stands aside whenever the critical side is waiting on it
+class spi_arbiter final {
+    StaticSemaphore_t m_mutex_buffer;
+    SemaphoreHandle_t m_mutex;
+    volatile uint32_t m_critical_waiting;
+    spi_arbiter(const spi_arbiter& rhs)=delete;
+    spi_arbiter& operator=(const spi_arbiter& rhs)=delete;
+public:
+    spi_arbiter();
+    // takes the bus for one critical transaction. returns how long
+    // it had to wait in microseconds
+    uint32_t critical_acquire();
+    void critical_release();
+    // takes the bus for one bulk chunk
+    void bulk_acquire();
+    void bulk_release();
+};
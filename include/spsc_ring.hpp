@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+// a lock free queue between exactly one producer and one consumer,
+// with fixed storage. each side's index lives on its own cache line
+// so the two cores don't bounce a shared line back and forth
+template<typename T, size_t Capacity, size_t CacheLine = 64>
+class spsc_ring final {
+    static_assert(Capacity>1 && 0==(Capacity&(Capacity-1)),"Capacity must be a power of two");
+    // producer side
+    alignas(CacheLine) size_t m_head;
+    uint32_t m_dropped;
+    // consumer side
+    alignas(CacheLine) size_t m_tail;
+    alignas(CacheLine) T m_items[Capacity];
+    spsc_ring(const spsc_ring& rhs)=delete;
+    spsc_ring& operator=(const spsc_ring& rhs)=delete;
+public:
+    constexpr static const size_t capacity = Capacity;
+    inline spsc_ring() : m_head(0),m_dropped(0),m_tail(0) {}
+    // producer only. returns false and counts a drop if full
+    bool push(const T& item) {
+        const size_t head = __atomic_load_n(&m_head,__ATOMIC_RELAXED);
+        if(head-__atomic_load_n(&m_tail,__ATOMIC_ACQUIRE)==Capacity) {
+            __atomic_store_n(&m_dropped,m_dropped+1,__ATOMIC_RELAXED);
+            return false;
+        }
+        m_items[head&(Capacity-1)]=item;
+        // publish the item before the index that covers it
+        __atomic_store_n(&m_head,head+1,__ATOMIC_RELEASE);
+        return true;
+    }
+    // consumer only. returns false if empty
+    bool pop(T* out_item) {
+        const size_t tail = __atomic_load_n(&m_tail,__ATOMIC_RELAXED);
+        if(tail==__atomic_load_n(&m_head,__ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        *out_item = m_items[tail&(Capacity-1)];
+        // hand the slot back only once we're done reading it
+        __atomic_store_n(&m_tail,tail+1,__ATOMIC_RELEASE);
+        return true;
+    }
+    inline size_t size() const {
+        return __atomic_load_n(&m_head,__ATOMIC_ACQUIRE)-__atomic_load_n(&m_tail,__ATOMIC_ACQUIRE);
+    }
+    inline bool empty() const { return size()==0; }
+    // how many pushes were refused for lack of room
+    inline uint32_t dropped() const { return __atomic_load_n(&m_dropped,__ATOMIC_RELAXED); }
+};
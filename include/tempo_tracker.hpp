@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+// estimates a tempo from tapped or played onsets
+// using integer math and no allocation
+class tempo_tracker final {
+public:
+    constexpr static const size_t history = 8;
+private:
+    // taps and onsets keep separate histories so one never skews the other
+    struct intervals {
+        uint32_t last;
+        uint32_t values[history];
+        size_t position;
+        size_t size;
+        void clear();
+        void add(uint32_t interval);
+        uint32_t median() const;
+    };
+    intervals m_taps;
+    intervals m_onsets;
+    int32_t m_microtempo;
+public:
+    // onsets closer than this are treated as one (chords, flams)
+    constexpr static const uint32_t debounce = 60000;
+    // taps further apart than this start a new measurement
+    constexpr static const uint32_t timeout = 2000000;
+    // the range of quarter note intervals we will lock onto (240 to 40 BPM)
+    constexpr static const uint32_t min_interval = 250000;
+    constexpr static const uint32_t max_interval = 1500000;
+    tempo_tracker();
+    void clear();
+    // each tap is a quarter note. taps take precedence: each one
+    // restarts the onset history, so following picks up from the
+    // tapped tempo. returns true if the estimate changed
+    bool tap(uint32_t timestamp);
+    // onsets may be subdivisions or multiples of the beat.
+    // returns true if the estimate changed
+    bool onset(uint32_t timestamp);
+    // the estimated microtempo, or zero if there isn't one yet
+    inline int32_t microtempo() const { return m_microtempo; }
+};
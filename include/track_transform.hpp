@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+// reshapes what a track plays: which channel, how high, how hard, and
+// which notes at all. the settings are compiled into lookup tables when
+// they change so shaping a message costs a few loads
+class track_transform final {
+public:
+    struct settings {
+        // the channel (0-15) everything moves to, or -1 to leave them be
+        int8_t channel;
+        // semitones up or down
+        int8_t transpose;
+        // notes outside this range once transposed are dropped
+        uint8_t low_note;
+        uint8_t high_note;
+        // note on velocities are scaled by this percentage
+        uint16_t velocity_scale;
+        // and bent by this power. below 1 is softer to reach loud,
+        // above 1 harder
+        float velocity_curve;
+    };
+private:
+    settings m_settings;
+    uint8_t m_dynamics;
+    bool m_identity;
+    uint8_t m_channels[16];
+    // the transposed note, or 0xFF if it's dropped
+    uint8_t m_notes[128];
+    // velocities through the scale and curve
+    uint8_t m_curve[128];
+    // and then the dynamics
+    uint8_t m_velocities[128];
+    void compile();
+    void compile_velocities();
+public:
+    track_transform();
+    // the settings that change nothing
+    static settings defaults();
+    inline const settings& current() const { return m_settings; }
+    void set(const settings& value);
+    // how hard the track was triggered. note on velocities are scaled
+    // by this over 127, so 127 plays them as recorded
+    inline uint8_t dynamics() const { return m_dynamics; }
+    void dynamics(uint8_t velocity);
+    // whether messages pass untouched
+    inline bool identity() const { return m_identity; }
+    // returns in if it's untouched, out filled with the reshaped copy,
+    // or nullptr if the message is dropped
+    const sfx::midi_message* shape(const sfx::midi_message& in, sfx::midi_message* out) const;
+};
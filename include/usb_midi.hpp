@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+// a message decoded from USB-MIDI event packets
+struct usb_midi_message {
+    uint8_t cable;
+    const uint8_t* data;
+    size_t size;
+};
+// a raw USB-MIDI event packet stamped with when it was received
+struct usb_midi_event {
+    uint32_t timestamp;
+    uint8_t packet[4];
+    // which controller it came from
+    uint8_t device;
+};
+// decodes 4-byte USB-MIDI event packets into MIDI wire messages,
+// reassembling system exclusive messages split across packets
+class usb_midi_decoder final {
+public:
+    // sysex longer than this is handed out in pieces. pieces after 
+    // the first start with a data byte rather than 0xF0
+    constexpr static const size_t max_sysex = 256;
+private:
+    uint8_t m_sysex[max_sysex];
+    size_t m_sysex_size;
+    bool m_in_sysex;
+public:
+    usb_midi_decoder();
+    void reset();
+    // gets the number of wire bytes for a code index number
+    static size_t cin_size(uint8_t cin);
+    // decodes one packet. returns true and fills out_message when a
+    // message (or a piece of sysex) is ready. the data is valid until
+    // the next call
+    bool decode(const uint8_t* packet, usb_midi_message* out_message);
+};
+// encodes MIDI wire messages as USB-MIDI event packets
+class usb_midi_encoder final {
+public:
+    // gets the code index number for a short message of the given wire
+    // size, or 0 if it can't be sent as one
+    static uint8_t cin(uint8_t status, size_t size);
+    // gets how many packets a sysex message takes. the status comes
+    // first, and an end is added unless the data ends with one
+    static size_t sysex_packets(const uint8_t* data, size_t size);
+    // builds one of those packets on cable 0
+    static void sysex_packet(uint8_t status, const uint8_t* data, size_t size, size_t index, uint8_t* out_packet);
+};
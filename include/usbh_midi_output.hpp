@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "midi_bulk_output.hpp"
+#include "spsc_ring.hpp"
+// output for controllers on the USB host port. the sending task queues
+// event packets and the USB task takes them between IN transfers, so
+// neither waits on the other
+class usbh_midi_output final : public midi_bulk_output {
+public:
+    // event packets waiting for the USB task (a power of two)
+    constexpr static const size_t capacity = 256;
+private:
+    struct packet {
+        uint8_t data[4];
+    };
+    spsc_ring<packet,capacity> m_packets;
+    size_t m_overruns;
+    usbh_midi_output(const usbh_midi_output& rhs)=delete;
+    usbh_midi_output& operator=(const usbh_midi_output& rhs)=delete;
+public:
+    usbh_midi_output();
+    // queues a message whole. returns device_error if there isn't room
+    virtual sfx::sfx_result send(const sfx::midi_message& message);
+    // USB task only. takes as many whole packets as fit in size bytes,
+    // and returns how many bytes it took
+    size_t take(uint8_t* out_buffer, size_t size);
+    inline bool empty() const { return m_packets.empty(); }
+    // messages turned away because the queue was full
+    inline size_t overruns() const { return m_overruns; }
+};
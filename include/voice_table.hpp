@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <sfx_midi_core.hpp>
+#include <sfx_midi_message.hpp>
+#include "note_tracker.hpp"
+// tracks the notes sounding on an output, shared by several owners.
+// owners past max_owners-1 aren't tracked at all: their messages pass
+// untouched and releasing them does nothing
+class voice_table final {
+public:
+    constexpr static const size_t max_voices = 128;
+    constexpr static const size_t max_owners = 64;
+private:
+    struct voice {
+        uint64_t owners;
+        uint8_t channel;
+        uint8_t note;
+        uint8_t refs;
+    };
+    // the voice index plus one for each channel and note, or 0 if silent
+    uint8_t m_index[16][128];
+    voice m_voices[max_voices];
+    uint8_t m_free[max_voices];
+    size_t m_free_size;
+    uint16_t m_channel_voices[16];
+    size_t m_all_notes_off_threshold;
+    void free_voice(size_t index);
+public:
+    voice_table();
+    void clear();
+    // when releasing at least this many voices on a channel no other
+    // owner is using, send All Notes Off instead. zero disables it.
+    // this only sees its owners' notes, so whatever it goes to has to
+    // spare anything else sounding (midi_router spares thru)
+    inline size_t all_notes_off_threshold() const { return m_all_notes_off_threshold; }
+    inline void all_notes_off_threshold(size_t value) { m_all_notes_off_threshold = value; }
+    // tracks a message from an owner. returns false if the message
+    // must not be sent because another owner still holds the note
+    bool process(size_t owner, const sfx::midi_message& message);
+    // sends note offs for the voices only this owner holds,
+    // and drops the owner from the rest
+    void release(size_t owner, midi_bulk_output* output);
+};
@@ -296,6 +296,65 @@ uint8_t USB::InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, ui
         return ( rcode);
 }
 
+/* Launches a single IN packet and returns without waiting for the result */
+uint8_t USB::inTransferStart(uint8_t addr, uint8_t ep) {
+        EpInfo *pep = NULL;
+        uint16_t nak_limit = 0;
+
+        uint8_t rcode = SetAddress(addr, ep, &pep, &nak_limit);
+
+        if(rcode)
+                return rcode;
+
+        regWr(rHCTL, (pep->bmRcvToggle) ? bmRCVTOG1 : bmRCVTOG0); //set toggle value
+        regWr(rHIRQ, bmHXFRDNIRQ); //drop any stale completion
+        regWr(rHXFR, (tokIN | pep->epAddr)); //launch the transfer
+        return 0;
+}
+
+/* Finishes a packet launched with inTransferStart(). While the transfer is in flight this is  */
+/* a single register read. rcode is USB_ERROR_TRANSFER_PENDING until then, otherwise as for    */
+/* inTransfer(), except that a NAK or toggle error is returned instead of retried              */
+uint8_t USB::inTransferComplete(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t* data) {
+        uint16_t nbytes = *nbytesptr;
+        *nbytesptr = 0;
+
+        // HIRQ comes back with the command byte, HRSL is only valid once HXFRDN is set
+        uint8_t hirq;
+        uint8_t hrsl = regRdStatus(rHRSL, &hirq);
+
+        if((hirq & bmHXFRDNIRQ) == 0)
+                return USB_ERROR_TRANSFER_PENDING;
+
+        EpInfo *pep = getEpInfoEntry(addr, ep);
+        uint8_t rcode = (hrsl & 0x0f);
+
+        if(!pep || rcode || (hirq & bmRCVDAVIRQ) == 0) {
+                regWr(rHIRQ, bmHXFRDNIRQ); //clear the interrupt
+                if(!pep)
+                        return USB_ERROR_EP_NOT_FOUND_IN_TBL;
+                if(rcode == hrTOGERR) {
+                        // flipped as in InTransfer() so the next attempt goes out with the right toggle
+                        pep->bmRcvToggle = (hrsl & bmRCVTOGRD) ? 0 : 1;
+                }
+                // RCVDAV is raised before the transfer completes, so the read above caught it
+                return rcode ? rcode : 0xf0; //receive error
+        }
+
+        uint8_t pktsize = regRd(rRCVBC); //number of received bytes
+
+        if(pktsize > nbytes)
+                pktsize = nbytes;
+
+        bytesRd(rRCVFIFO, pktsize, data);
+        regWr(rHIRQ, bmHXFRDNIRQ | bmRCVDAVIRQ); // Clear both IRQs & free the buffer in one write
+        *nbytesptr = pktsize;
+
+        // Save toggle value
+        pep->bmRcvToggle = (hrsl & bmRCVTOGRD) ? 1 : 0;
+        return 0;
+}
+
 /* OUT transfer to arbitrary endpoint. Handles multiple packets if necessary. Transfers 'nbytes' bytes. */
 /* Handles NAK bug per Maxim Application Note 4000 for single buffer transfer   */
 
@@ -100,6 +100,7 @@ typedef MAX3421e<P10, P9> MAX3421E; // Official Arduinos (UNO, Duemilanove, Mega
 #define USB_ERROR_CLASS_INSTANCE_ALREADY_IN_USE         0xD9
 #define USB_ERROR_INVALID_MAX_PKT_SIZE                  0xDA
 #define USB_ERROR_EP_NOT_FOUND_IN_TBL                   0xDB
+#define USB_ERROR_TRANSFER_PENDING                      0xDC
 #define USB_ERROR_CONFIG_REQUIRES_ADDITIONAL_RESET      0xE0
 #define USB_ERROR_FailGetDevDescr                       0xE1
 #define USB_ERROR_FailSetDevTblEntry                    0xE2
@@ -262,6 +263,10 @@ public:
         uint8_t ctrlStatus(uint8_t ep, bool direction, uint16_t nak_limit);
         uint8_t inTransfer(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t* data, uint8_t bInterval = 0);
         uint8_t outTransfer(uint8_t addr, uint8_t ep, uint16_t nbytes, uint8_t* data);
+        /* Single packet IN without waiting. Start launches the token and returns, Complete returns
+           USB_ERROR_TRANSFER_PENDING until the host signals HXFRDN. Nothing else may use the bus in between */
+        uint8_t inTransferStart(uint8_t addr, uint8_t ep);
+        uint8_t inTransferComplete(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t* data);
         uint8_t dispatchPkt(uint8_t token, uint8_t ep, uint16_t nak_limit);
 
         void Task(void);
@@ -132,6 +132,13 @@ e-mail   :  support@circuitsathome.com
 // define XMEM_ACQUIRE_SPI and XMEM_RELEASE_SPI to point to your lock and unlock.
 // NOTE: NO argument is passed. You have to do this within your routine for
 // whatever you are using to lock and unlock.
+#if defined(USB_SPI_ARBITER) && !defined(XMEM_ACQUIRE_SPI)
+// the application shares the SPI host with other devices and provides these
+extern void usb_spi_acquire();
+extern void usb_spi_release();
+#define XMEM_ACQUIRE_SPI() usb_spi_acquire()
+#define XMEM_RELEASE_SPI() usb_spi_release()
+#endif
 #if !defined(XMEM_ACQUIRE_SPI)
 #if USE_XMEM_SPI_LOCK || defined(USE_MULTIPLE_APP_API)
 #include <xmem.h>
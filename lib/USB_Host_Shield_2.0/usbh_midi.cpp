@@ -86,7 +86,9 @@ USBH_MIDI::USBH_MIDI(USB *p) :
 pUsb(p),
 bAddress(0),
 bPollEnable(false),
-readPtr(0) {
+readPtr(0),
+bRecvPending(false),
+recvStarted(0) {
         // initialize endpoint data structures
         for(uint8_t i=0; i<MIDI_MAX_ENDPOINTS; i++) {
                 epInfo[i].epAddr      = 0;
@@ -283,6 +285,7 @@ uint8_t USBH_MIDI::Release()
         bAddress     = 0;
         bPollEnable  = false;
         readPtr      = 0;
+        bRecvPending = false;
 
         return 0;
 }
@@ -326,6 +329,35 @@ uint8_t USBH_MIDI::RecvData(uint16_t *bytes_rcvd, uint8_t *dataptr)
         return r;
 }
 
+/* Receive data from MIDI device without waiting on the bus */
+uint8_t USBH_MIDI::RecvDataAsync(uint16_t *bytes_rcvd, uint8_t *dataptr)
+{
+        uint8_t r;
+        *bytes_rcvd = 0;
+        if( bPollEnable == false ) return USB_ERROR_INVALID_ARGUMENT;
+
+        if( bRecvPending == false ) {
+                r = pUsb->inTransferStart(bAddress, epInfo[epDataInIndex].epAddr);
+                if( r ) return r;
+                bRecvPending = true;
+                recvStarted  = (uint32_t)millis();
+                return USB_ERROR_TRANSFER_PENDING;
+        }
+        *bytes_rcvd = (uint16_t)epInfo[epDataInIndex].maxPktSize;
+        r = pUsb->inTransferComplete(bAddress, epInfo[epDataInIndex].epAddr, bytes_rcvd, dataptr);
+        if( r == USB_ERROR_TRANSFER_PENDING ) {
+                // the host always finishes a transfer, but don't wedge on a lost one
+                if( (uint32_t)millis() - recvStarted < USB_XFER_TIMEOUT ) return r;
+                r = USB_ERROR_TRANSFER_TIMEOUT;
+        }
+        bRecvPending = false;
+#ifdef EXTRADEBUG
+        if( r && r != hrNAK )
+                USBTRACE2("inTransferComplete():", r);
+#endif
+        return r;
+}
+
 /* Receive data from MIDI device */
 uint8_t USBH_MIDI::RecvData(uint8_t *outBuf, bool isRaw)
 {
@@ -94,6 +94,9 @@ protected:
         /* MIDI Event packet buffer */
         uint8_t recvBuf[MIDI_EVENT_PACKET_SIZE];
         uint8_t readPtr;
+        /* Asynchronous receive state */
+        bool     bRecvPending;
+        uint32_t recvStarted;
 
         uint16_t countSysExDataSize(uint8_t *dataptr);
         void setupDeviceSpecific();
@@ -120,8 +123,16 @@ public:
         uint8_t RecvData(uint16_t *bytes_rcvd, uint8_t *dataptr);
         uint8_t RecvData(uint8_t *outBuf, bool isRaw=false);
         inline uint8_t RecvRawData(uint8_t *outBuf) { return RecvData(outBuf, true); };
+        // Non-blocking receive. Launches an IN when none is outstanding, and returns
+        // USB_ERROR_TRANSFER_PENDING until it finishes. A NAK is returned as hrNAK
+        uint8_t RecvDataAsync(uint16_t *bytes_rcvd, uint8_t *dataptr);
+        inline bool RecvPending() { return bRecvPending; };
         uint8_t SendData(uint8_t *dataptr, uint8_t nCable=0);
         inline uint8_t SendRawData(uint16_t bytes_send, uint8_t *dataptr) { return pUsb->outTransfer(bAddress, epInfo[epDataOutIndex].epAddr, bytes_send, dataptr); };
+        // The most the DataOUT endpoint takes in one packet
+        inline uint8_t SendMaxPacketSize() { return epInfo[epDataOutIndex].maxPktSize; };
+        // The DataOUT endpoint's address, or 0 if the device has none
+        inline uint8_t SendEndpoint() { return epInfo[epDataOutIndex].epAddr; };
         uint8_t lookupMsgSize(uint8_t midiMsg, uint8_t cin=0);
         uint8_t SendSysEx(uint8_t *dataptr, uint16_t datasize, uint8_t nCable=0);
         uint8_t extractSysExData(uint8_t *p, uint8_t *buf);
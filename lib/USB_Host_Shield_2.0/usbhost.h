@@ -144,6 +144,7 @@ public:
         uint8_t* bytesWr(uint8_t reg, uint8_t nbytes, uint8_t* data_p);
         void gpioWr(uint8_t data);
         uint8_t regRd(uint8_t reg);
+        uint8_t regRdStatus(uint8_t reg, uint8_t* status);
         uint8_t* bytesRd(uint8_t reg, uint8_t nbytes, uint8_t* data_p);
         uint8_t gpioRd();
         uint8_t gpioRdOutput();
@@ -202,7 +203,12 @@ void MAX3421e< SPI_SS, INTR >::regWr(uint8_t reg, uint8_t data) {
         c[0] = reg | 0x02;
         c[1] = data;
         HAL_SPI_Transmit(&SPI_Handle, c, 2, HAL_MAX_DELAY);
-#elif !defined(SPDR) // ESP8266, ESP32
+#elif defined(ESP32)
+        uint8_t c[2];
+        c[0] = reg | 0x02;
+        c[1] = data;
+        USB_SPI.writeBytes(c, 2);
+#elif !defined(SPDR) // ESP8266
         USB_SPI.transfer(reg | 0x02);
         USB_SPI.transfer(data);
 #else
@@ -239,8 +245,13 @@ uint8_t* MAX3421e< SPI_SS, INTR >::bytesWr(uint8_t reg, uint8_t nbytes, uint8_t*
         HAL_SPI_Transmit(&SPI_Handle, &data, 1, HAL_MAX_DELAY);
         HAL_SPI_Transmit(&SPI_Handle, data_p, nbytes, HAL_MAX_DELAY);
         data_p += nbytes;
+#elif defined(ESP32)
+        // one pass through the hardware FIFO instead of a transfer per byte
+        USB_SPI.transfer(reg | 0x02);
+        USB_SPI.writeBytes(data_p, nbytes);
+        data_p += nbytes;
 #elif !defined(__AVR__) || !defined(SPDR)
-#if defined(ESP8266) || defined(ESP32)
+#if defined(ESP8266)
         yield();
 #endif
         USB_SPI.transfer(reg | 0x02);
@@ -297,6 +308,13 @@ uint8_t MAX3421e< SPI_SS, INTR >::regRd(uint8_t reg) {
         uint8_t rv = 0;
         HAL_SPI_Receive(&SPI_Handle, &rv, 1, HAL_MAX_DELAY);
         SPI_SS::Set();
+#elif defined(ESP32)
+        uint8_t c[2];
+        c[0] = reg;
+        c[1] = 0; // Send empty byte
+        USB_SPI.transferBytes(c, c, 2);
+        uint8_t rv = c[1];
+        SPI_SS::Set();
 #elif !defined(SPDR) || defined(SPI_HAS_TRANSACTION)
         USB_SPI.transfer(reg);
         uint8_t rv = USB_SPI.transfer(0); // Send empty byte
@@ -316,6 +334,33 @@ uint8_t MAX3421e< SPI_SS, INTR >::regRd(uint8_t reg) {
         XMEM_RELEASE_SPI();
         return (rv);
 }
+/* register read that also returns the status byte the MAX3421E clocks out */
+/* with the command in full duplex mode. In host mode that's HIRQ, so a     */
+/* transfer's completion and its result come back in one transaction        */
+template< typename SPI_SS, typename INTR >
+uint8_t MAX3421e< SPI_SS, INTR >::regRdStatus(uint8_t reg, uint8_t* status) {
+#if defined(ESP32)
+        XMEM_ACQUIRE_SPI();
+#if defined(SPI_HAS_TRANSACTION)
+        USB_SPI.beginTransaction(SPISettings(26000000, MSBFIRST, SPI_MODE0)); // The MAX3421E can handle up to 26MHz, use MSB First and SPI mode 0
+#endif
+        SPI_SS::Clear();
+        uint8_t c[2];
+        c[0] = reg;
+        c[1] = 0; // Send empty byte
+        USB_SPI.transferBytes(c, c, 2);
+        SPI_SS::Set();
+#if defined(SPI_HAS_TRANSACTION)
+        USB_SPI.endTransaction();
+#endif
+        XMEM_RELEASE_SPI();
+        *status = c[0];
+        return (c[1]);
+#else
+        *status = regRd(rHIRQ);
+        return regRd(reg);
+#endif
+}
 /* multiple-byte register read  */
 
 /* returns a pointer to a memory position after last read   */
@@ -345,7 +390,12 @@ uint8_t* MAX3421e< SPI_SS, INTR >::bytesRd(uint8_t reg, uint8_t nbytes, uint8_t*
         memset(data_p, 0, nbytes); // Make sure we send out empty bytes
         HAL_SPI_Receive(&SPI_Handle, data_p, nbytes, HAL_MAX_DELAY);
         data_p += nbytes;
-#elif !defined(SPDR) // ESP8266, ESP32
+#elif defined(ESP32)
+        // one pass through the hardware FIFO instead of a transfer per byte
+        USB_SPI.transfer(reg);
+        USB_SPI.transferBytes(NULL, data_p, nbytes);
+        data_p += nbytes;
+#elif !defined(SPDR) // ESP8266
         yield();
         USB_SPI.transfer(reg);
         while(nbytes) {
@@ -0,0 +1,239 @@
+#include "channel_tracker.hpp"
+#include <string.h>
+using namespace sfx;
+constexpr static const uint8_t dirty_pressure = 1;
+constexpr static const uint8_t dirty_pitch = 2;
+constexpr static const uint8_t dirty_program = 4;
+// controllers we never restore: data entry, increment/decrement,
+// (N)RPN selection, and the channel mode messages
+static bool untracked_control(uint8_t control) {
+    return control==6 || control==38 || (control>=96 && control<=101) || control>=120;
+}
+static uint8_t default_control(uint8_t control) {
+    switch(control) {
+        case 7: // volume
+            return 100;
+        case 8: // balance
+        case 10: // pan
+            return 64;
+        case 11: // expression
+            return 127;
+        default:
+            return 0;
+    }
+}
+static void set_bit(uint64_t* words, uint8_t index, bool value) {
+    const uint64_t mask = uint64_t(1)<<(index&63);
+    if(value) {
+        words[(index>>6)&1]|=mask;
+    } else {
+        words[(index>>6)&1]&=~mask;
+    }
+}
+static void flush_batch(midi_bulk_output& output, midi_message* batch, size_t* size, sfx_result* result) {
+    if(*size) {
+        sfx_result r = output.send(batch,*size);
+        if(r!=sfx_result::success) {
+            *result = r;
+        }
+        *size = 0;
+    }
+}
+channel_tracker::channel_tracker() : m_baseline(nullptr) {
+    clear();
+}
+void channel_tracker::defaults(midi_context* out_context) {
+    for(int c = 0;c<16;++c) {
+        midi_channel_context& ch = out_context->channels[c];
+        memset(ch.note,0,sizeof(ch.note));
+        memset(ch.key_pressure,0,sizeof(ch.key_pressure));
+        for(int i = 0;i<128;++i) {
+            ch.control[i]=default_control(i);
+        }
+        ch.pressure = 0;
+        ch.pitch = 0;
+        ch.program = 0;
+    }
+}
+uint8_t channel_tracker::baseline_control(uint8_t channel, uint8_t control) const {
+    if(m_baseline==nullptr) {
+        return default_control(control);
+    }
+    return m_baseline->channels[channel].control[control];
+}
+uint8_t channel_tracker::baseline_key_pressure(uint8_t channel, uint8_t note) const {
+    if(m_baseline==nullptr) {
+        return 0;
+    }
+    return m_baseline->channels[channel].key_pressure[note];
+}
+uint8_t channel_tracker::baseline_pressure(uint8_t channel) const {
+    if(m_baseline==nullptr) {
+        return 0;
+    }
+    return m_baseline->channels[channel].pressure;
+}
+int16_t channel_tracker::baseline_pitch(uint8_t channel) const {
+    if(m_baseline==nullptr) {
+        return 0;
+    }
+    return m_baseline->channels[channel].pitch;
+}
+uint8_t channel_tracker::baseline_program(uint8_t channel) const {
+    if(m_baseline==nullptr) {
+        return 0;
+    }
+    return m_baseline->channels[channel].program;
+}
+void channel_tracker::baseline(const midi_context* value) {
+    m_baseline = value;
+    clear();
+}
+void channel_tracker::clear() {
+    if(m_baseline==nullptr) {
+        defaults(&m_state);
+    } else {
+        m_state = *m_baseline;
+    }
+    memset(m_dirty,0,sizeof(m_dirty));
+}
+void channel_tracker::process(const midi_message& message) {
+    if(message.status<0x80 || message.status>=0xF0) {
+        return;
+    }
+    const uint8_t c = message.channel();
+    midi_channel_context& ch = m_state.channels[c];
+    dirty_bits& d = m_dirty[c];
+    switch(message.type()) {
+        case midi_message_type::note_off:
+            ch.note[message.msb()&0x7F]=0;
+            break;
+        case midi_message_type::note_on:
+            ch.note[message.msb()&0x7F]=message.lsb();
+            break;
+        case midi_message_type::polyphonic_pressure: {
+            const uint8_t n = message.msb()&0x7F;
+            ch.key_pressure[n]=message.lsb();
+            set_bit(d.key_pressure,n,ch.key_pressure[n]!=baseline_key_pressure(c,n));
+            break;
+        }
+        case midi_message_type::control_change: {
+            const uint8_t cc = message.msb()&0x7F;
+            if(untracked_control(cc)) {
+                break;
+            }
+            ch.control[cc]=message.lsb();
+            set_bit(d.control,cc,ch.control[cc]!=baseline_control(c,cc));
+            break;
+        }
+        case midi_message_type::program_change:
+            ch.program = message.value8;
+            if(ch.program!=baseline_program(c)) {
+                d.flags|=dirty_program;
+            } else {
+                d.flags&=~dirty_program;
+            }
+            break;
+        case midi_message_type::channel_pressure:
+            ch.pressure = message.value8;
+            if(ch.pressure!=baseline_pressure(c)) {
+                d.flags|=dirty_pressure;
+            } else {
+                d.flags&=~dirty_pressure;
+            }
+            break;
+        case midi_message_type::pitch_wheel_change:
+            // the first data byte is the low 7 bits
+            ch.pitch = int16_t(((message.lsb()&0x7F)<<7)|(message.msb()&0x7F))-8192;
+            if(ch.pitch!=baseline_pitch(c)) {
+                d.flags|=dirty_pitch;
+            } else {
+                d.flags&=~dirty_pitch;
+            }
+            break;
+        default:
+            break;
+    }
+}
+uint16_t channel_tracker::dirty() const {
+    uint16_t result = 0;
+    for(int c = 0;c<16;++c) {
+        const dirty_bits& d = m_dirty[c];
+        if(d.control[0]|d.control[1]|d.key_pressure[0]|d.key_pressure[1]|d.flags) {
+            result|=(1<<c);
+        }
+    }
+    return result;
+}
+sfx_result channel_tracker::reset(uint16_t channels, midi_bulk_output& output) {
+    midi_message batch[batch_size];
+    size_t size = 0;
+    sfx_result result = sfx_result::success;
+    for(int c = 0;c<16;++c) {
+        if(0==(channels&(1<<c))) {
+            continue;
+        }
+        dirty_bits& d = m_dirty[c];
+        midi_channel_context& ch = m_state.channels[c];
+        // controllers first so bank select lands before the program change
+        for(int w = 0;w<2;++w) {
+            uint64_t bits = d.control[w];
+            while(bits) {
+                const uint8_t cc = uint8_t(__builtin_ctzll(bits)+(w<<6));
+                bits&=bits-1;
+                ch.control[cc]=baseline_control(c,cc);
+                midi_message& msg = batch[size++];
+                msg.status = uint8_t(uint8_t(midi_message_type::control_change)|uint8_t(c));
+                msg.msb(cc);
+                msg.lsb(ch.control[cc]);
+                if(size==batch_size) {
+                    flush_batch(output,batch,&size,&result);
+                }
+            }
+            d.control[w]=0;
+        }
+        for(int w = 0;w<2;++w) {
+            uint64_t bits = d.key_pressure[w];
+            while(bits) {
+                const uint8_t n = uint8_t(__builtin_ctzll(bits)+(w<<6));
+                bits&=bits-1;
+                ch.key_pressure[n]=baseline_key_pressure(c,n);
+                midi_message& msg = batch[size++];
+                msg.status = uint8_t(uint8_t(midi_message_type::polyphonic_pressure)|uint8_t(c));
+                msg.msb(n);
+                msg.lsb(ch.key_pressure[n]);
+                if(size==batch_size) {
+                    flush_batch(output,batch,&size,&result);
+                }
+            }
+            d.key_pressure[w]=0;
+        }
+        // leave room for the three remaining messages
+        if(size+3>batch_size) {
+            flush_batch(output,batch,&size,&result);
+        }
+        if(d.flags&dirty_program) {
+            ch.program = baseline_program(c);
+            midi_message& msg = batch[size++];
+            msg.status = uint8_t(uint8_t(midi_message_type::program_change)|uint8_t(c));
+            msg.value8 = ch.program;
+        }
+        if(d.flags&dirty_pressure) {
+            ch.pressure = baseline_pressure(c);
+            midi_message& msg = batch[size++];
+            msg.status = uint8_t(uint8_t(midi_message_type::channel_pressure)|uint8_t(c));
+            msg.value8 = ch.pressure;
+        }
+        if(d.flags&dirty_pitch) {
+            ch.pitch = baseline_pitch(c);
+            const uint16_t v = uint16_t(ch.pitch+8192);
+            midi_message& msg = batch[size++];
+            msg.status = uint8_t(uint8_t(midi_message_type::pitch_wheel_change)|uint8_t(c));
+            msg.msb(v&0x7F);
+            msg.lsb((v>>7)&0x7F);
+        }
+        d.flags = 0;
+    }
+    flush_batch(output,batch,&size,&result);
+    return result;
+}
@@ -0,0 +1,124 @@
+#include "key_map.hpp"
+#include <string.h>
+using namespace sfx;
+static bool is_space(int ch) {
+    return ch==' ' || ch=='\t' || ch=='\r' || ch==',';
+}
+// reads the next field on the current line into buf. returns false at
+// the end of the line (or stream), leaving *ch on the terminator
+static bool read_field(stream& stm, int* ch, char* buf, size_t size) {
+    while(is_space(*ch)) {
+        *ch = stm.getch();
+    }
+    if(*ch=='#') {
+        while(*ch!='\n' && *ch!=-1) {
+            *ch = stm.getch();
+        }
+    }
+    if(*ch=='\n' || *ch==-1) {
+        return false;
+    }
+    size_t i = 0;
+    while(*ch!=-1 && *ch!='\n' && *ch!='#' && !is_space(*ch)) {
+        if(i+1<size) {
+            buf[i++]=(char)*ch;
+        }
+        *ch = stm.getch();
+    }
+    buf[i]=0;
+    return true;
+}
+static bool parse_number(const char* sz, int* out_value) {
+    if(*sz==0) {
+        return false;
+    }
+    int result = 0;
+    while(*sz) {
+        if(*sz<'0' || *sz>'9' || result>9999) {
+            return false;
+        }
+        result = result*10+(*sz++-'0');
+    }
+    *out_value = result;
+    return true;
+}
+static bool parse_action(const char* sz, key_action* out_action) {
+    if(sz[0]==0 || sz[1]!=0) {
+        return false;
+    }
+    switch(sz[0]) {
+        case 's':
+            *out_action = key_action::start;
+            return true;
+        case 'x':
+            *out_action = key_action::stop;
+            return true;
+        case 't':
+            *out_action = key_action::toggle;
+            return true;
+        case 'm':
+            *out_action = key_action::momentary;
+            return true;
+        case 'u':
+            *out_action = key_action::mute;
+            return true;
+        default:
+            return false;
+    }
+}
+key_map::key_map() {
+    clear();
+}
+void key_map::clear() {
+    memset(m_bindings,0,sizeof(m_bindings));
+}
+sfx_result key_map::set(uint8_t channel, uint8_t note, key_action action, size_t track, size_t count) {
+    if(channel>15 || note>127 || note+count>128 || track+count>256) {
+        return sfx_result::invalid_argument;
+    }
+    for(size_t i = 0;i<count;++i) {
+        key_binding& b = m_bindings[channel][note+i];
+        b.action = action;
+        b.track = uint8_t(track+i);
+    }
+    return sfx_result::success;
+}
+sfx_result key_map::read(stream& stream, key_map* out_map) {
+    if(out_map==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    out_map->clear();
+    char field[8];
+    int ch = stream.getch();
+    while(ch!=-1) {
+        int values[5];
+        key_action action = key_action::none;
+        size_t fields = 0;
+        while(read_field(stream,&ch,field,sizeof(field))) {
+            bool ok;
+            if(fields==2) {
+                ok = parse_action(field,&action);
+            } else {
+                ok = fields<5 && parse_number(field,&values[fields]);
+            }
+            if(!ok) {
+                return sfx_result::invalid_argument;
+            }
+            ++fields;
+        }
+        if(fields!=0) {
+            if(fields<4 || values[0]<1 || values[0]>16 || values[1]>127 || values[3]<1) {
+                return sfx_result::invalid_argument;
+            }
+            // tracks are numbered from 1 in the file
+            sfx_result r = out_map->set(uint8_t(values[0]-1),uint8_t(values[1]),action,values[3]-1,fields==5?values[4]:1);
+            if(r!=sfx_result::success) {
+                return r;
+            }
+        }
+        if(ch=='\n') {
+            ch = stream.getch();
+        }
+    }
+    return sfx_result::success;
+}
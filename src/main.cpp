@@ -42,13 +42,49 @@ A wire from 5v to the VBUS contact behind the USB port must be soldered. */
 // BL is hooked to +3.3v
 #define LCD_BL -1
 #define LCD_ROTATION 3
+// the most pixels the display writes before letting the USB host
+// have the bus (about 0.5ms at 40MHz, plus at most one row)
+#define LCD_CHUNK_PIXELS 1024
 
 // USB host CS
 #define USB_CS 5
+// USB host INT (the USB Host Shield library's default on ESP32)
+#define USB_INT 13
+// how often to poll the controller for input (ms)
+#define USB_POLL_INTERVAL 1
+// how often to run USB housekeeping (hubs, etc) without an IRQ (ms)
+#define USB_TASK_INTERVAL 8
+// how many MIDI controllers can be connected at once (through a hub)
+#define USB_MIDI_DEVICES 4
+// how many controllers /prang.dev can describe
+#define USB_MIDI_ROUTES 8
+// received event packets waiting for the sequencer (a power of two)
+#define INPUT_RING_SIZE 256
+// bus wait samples waiting for the sequencer's stats (a power of two)
+#define BUS_WAIT_RING_SIZE 32
+// event packets kept for the controllers on the host port, each read
+// at its own pace (a power of two)
+#define USB_OUT_RING_SIZE 256
+// how long a controller may take no OUT data before its backlog is
+// dropped so it stops holding up the others (ms)
+#define USB_OUT_TIMEOUT 100
+// task priorities. both run on the core loop() doesn't. the host shield
+// library busy-waits on transfers (a control transfer can spin for its
+// whole timeout), so the USB task runs below the sequencer, which only
+// wakes briefly each tick and lets it have the core in between
+#define USB_TASK_PRIORITY 22
+#define MIDI_TASK_PRIORITY 23
 
 // SD Card reader CS
 #define SD_CS 1
 
+// MIDI DIN out, on UART1 (the S3's defaults for it)
+#define DIN_RX 15
+#define DIN_TX 16
+// how many bytes may wait for the DIN wire before the scheduler holds
+// and reorders the rest. each byte is 320us at 31250 baud
+#define DIN_BACKLOG 16
+
 #include <Arduino.h>
 #include <ESP32Encoder.h>
 #include <SD.h>
@@ -69,10 +105,23 @@ A wire from 5v to the VBUS contact behind the USB port must be soldered. */
 #include <sfx.hpp>
 #include <tft_io.hpp>
 #include <thread.hpp>
+#include "arbitrated_target.hpp"
+#include "key_map.hpp"
+#include "midi_delay.hpp"
+#include "midi_merger.hpp"
 #include "midi_esptinyusb.hpp"
 #include "midi_quantizer.hpp"
+#include "midi_router.hpp"
 #include "midi_sampler.hpp"
+#include "midi_scheduler.hpp"
+#include "midi_serial.hpp"
+#include "midi_stats.hpp"
+#include "spi_arbiter.hpp"
+#include "spsc_ring.hpp"
+#include "tempo_tracker.hpp"
 #include "telegrama.hpp"
+#include "usb_midi.hpp"
+#include "usbh_midi_output.hpp"
 using namespace arduino;
 using namespace sfx;
 using namespace gfx;
@@ -86,9 +135,29 @@ using lcd_t = st7789<135,240, LCD_DC, LCD_RST, LCD_BL, bus_t, LCD_ROTATION,true,
 using color_t = color<typename lcd_t::pixel_type>;
 
 midi_esptinyusb midi_out;
+// DIN out on UART1, at DIN_TX
+midi_serial_output<> midi_din(Serial1);
+// the DIN port is slow enough to need its traffic prioritized
+midi_scheduler din_queue(&midi_din);
+// output for the controllers on the host port
+usbh_midi_output usbh_out;
+// each port can be held back to line up with slower ones
+midi_delay usb_delay(&midi_out);
+midi_delay din_delay(&din_queue);
+midi_delay host_delay(&usbh_out);
+midi_delay* port_delays[] = {&usb_delay, &din_delay, &host_delay};
+// sends tracks and thru to the ports /prang.out picks
+midi_router router;
+// puts tracks and thru in the order they were due before routing them
+midi_merger merger(&router, midi_stats::now);
 USB Usb;
+// 7 port hubs are two hubs chained
 USBHub Hub(&Usb);
-USBH_MIDI midi_in(&Usb);
+USBHub Hub2(&Usb);
+// one per USB_MIDI_DEVICES
+USBH_MIDI midi_in[USB_MIDI_DEVICES] = {&Usb, &Usb, &Usb, &Usb};
+// each controller reassembles its own sysex
+usb_midi_decoder usb_decoders[USB_MIDI_DEVICES];
 
 struct midi_file_info final {
     int type;
@@ -99,6 +168,7 @@ struct midi_file_info final {
 struct queue_info {
     int cmd;
     float value;
+    uint32_t timestamp;
 };
 using message_queue_t = message_queue<queue_info>;
 message_queue_t queue_to_thread;
@@ -109,124 +179,609 @@ button<BUTTON_B> button_b;
 ESP32Encoder encoder;
 int64_t encoder_prev_count;
 lcd_t lcd;
+// the LCD and the USB host share HSPI. the USB host goes first
+spi_arbiter spi_bus;
+arbitrated_target<lcd_t, LCD_CHUNK_PIXELS> display(lcd, spi_bus);
 uint8_t* prang_font_buffer;
 size_t prang_font_buffer_size;
 buffer_stream prang_buffer_stream;
 File file;
 midi_sampler sampler;
 midi_quantizer quantizer;
+midi_stats stats;
+// what loop() prints. midi_task fills it in when asked, so the
+// figures aren't read while they're being written
+midi_stats stats_view;
+// when a snapshot was asked for and not printed yet, or 0
+uint32_t stats_view_asked = 0;
+arduino_stream serial_stream(&Serial);
 thread midi_thread;
+thread usb_thread;
+TaskHandle_t midi_task_handle = nullptr;
+TaskHandle_t usb_task_handle = nullptr;
+// from the USB host task to the sequencer
+spsc_ring<usb_midi_event, INPUT_RING_SIZE> input_ring;
+// bus waits seen by the USB host task. the sequencer owns the stats,
+// so it folds these in rather than having two tasks write them
+spsc_ring<uint32_t, BUS_WAIT_RING_SIZE> bus_wait_ring;
 midi_file_info file_info;
 int last_status = 0;
 float tempo_multiplier;
 int base_octave;
+// which keys do what to which tracks. without /prang.map on the SD,
+// channel 1 from base_octave up plays the tracks momentarily. tracks
+// are numbered from 1 in the map, the same as in /prang.trk
+key_map keys;
+bool has_key_map = false;
+// per controller routing from /prang.dev, one controller per line:
+//   vid pid map thru [out]
+// vid and pid are hex, map is a key map file or - for the default,
+// thru is 1 to pass unused input on to the ports or 0 not to, and
+// out is 1 to send the host port's output to the controller
+struct device_route {
+    uint16_t vid;
+    uint16_t pid;
+    // nullptr uses keys
+    key_map* keys;
+    bool thru;
+    bool out;
+};
+device_route device_routes[USB_MIDI_ROUTES];
+size_t device_routes_size = 0;
+// the routing in effect for each connected controller
+const key_map* device_keys[USB_MIDI_DEVICES];
+bool device_thru[USB_MIDI_DEVICES];
+bool device_out[USB_MIDI_DEVICES];
+// host port packets dropped for controllers that stopped taking them
+uint32_t device_out_dropped = 0;
+// the key on channel 0 used for tap tempo, or -1
+int tap_note = -1;
+// nonzero to follow the tempo of the triggers
+int tempo_follow = 0;
+// nonzero to play tracks as hard as their triggers are hit
+int velocity_triggers = 1;
+tempo_tracker tempo;
+bool tap_pressed = false;
 int64_t encoder_old_count;
 int quantize_beats;
 int quantize_next_follow_track = -1;
 int* quantize_track_adv;
 int* quantized_pressed;
 uint32_t off_ts;
-void midi_task(void* state) {
+static void update_tempo_follow() {
+    int32_t mt = tempo.microtempo();
+    if (mt == 0) {
+        return;
+    }
+    sampler.fixed_microtempo(mt);
+    queue_info qi;
+    qi.cmd = 2;
+    qi.value = midi_utility::microtempo_to_tempo(mt);
+    qi.timestamp = 0;
+    queue_to_main.send(qi, false);
+}
+static void trigger(const key_binding& binding, bool pressed, int velocity, uint32_t received) {
+    const size_t track = binding.track;
+    if (track >= sampler.tracks_count()) {
+        return;
+    }
+    bool start = false;
+    bool stop = false;
+    switch (binding.action) {
+        case key_action::start:
+            start = pressed;
+            break;
+        case key_action::stop:
+            stop = pressed;
+            break;
+        case key_action::toggle:
+            if (pressed) {
+                start = !sampler.started(track);
+                stop = !start;
+            }
+            break;
+        case key_action::momentary:
+            start = pressed;
+            stop = !pressed;
+            break;
+        case key_action::mute:
+            if (pressed) {
+                sampler.mute(track, !sampler.muted(track));
+            }
+            break;
+        default:
+            break;
+    }
+    if (start) {
+        stats.key(track, received);
+        // only rebuilds the velocity table if it changed
+        sampler.dynamics(track, velocity_triggers ? velocity : 127);
+        if (tempo_follow && tempo.onset(received)) {
+            update_tempo_follow();
+        }
+        quantizer.start(track, received);
+        queue_info qi;
+        qi.cmd = 1;
+        qi.value = (int)quantizer.last_timing();
+        qi.timestamp = received;
+        queue_to_main.send(qi, false);
+    } else if (stop) {
+        quantizer.stop(track);
+    }
+}
+// returns true if the message was consumed, false if it should go thru
+static bool process_input(const usb_midi_message& msg, const key_map& map, uint32_t received) {
+    const uint8_t* p = msg.data;
+    last_status = *(p++);
+    bool note_on = false;
+    int note;
+    int vel;
+    int s = last_status;
+    if (s < 0xF0) {
+        s &= 0xF0;
+    }
+    switch ((midi_message_type)s) {
+        case midi_message_type::note_on:
+            note_on = true;
+        case midi_message_type::note_off:
+            note = *(p++);
+            vel = *(p++);
+            if ((last_status & 0x0F) == 0 && note == tap_note) {
+                if (note_on && vel > 0 && tempo.tap(received)) {
+                    update_tempo_follow();
+                }
+                return true;
+            }
+            {
+                const key_binding& binding = map.lookup(last_status & 0x0F, note);
+                if (binding.action != key_action::none) {
+                    trigger(binding, note_on && vel > 0, vel, received);
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+// the USB host library takes the bus through these for each transaction
+void usb_spi_acquire() {
+    uint32_t waited = spi_bus.critical_acquire();
+    if (waited != 0) {
+        bus_wait_ring.push(waited);
+    }
+}
+void usb_spi_release() {
+    spi_bus.critical_release();
+}
+static void IRAM_ATTR usb_isr() {
+    BaseType_t woken = pdFALSE;
+    if (usb_task_handle != nullptr) {
+        vTaskNotifyGiveFromISR(usb_task_handle, &woken);
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+static key_map* load_key_map(const char* name) {
+    char path[40];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    File f = SD.open(path, "r");
+    if (!f) {
+        return nullptr;
+    }
+    key_map* result = (key_map*)malloc(sizeof(key_map));
+    if (result != nullptr) {
+        file_stream fs(f);
+        if (sfx_result::success != key_map::read(fs, result)) {
+            free(result);
+            result = nullptr;
+        }
+    }
+    f.close();
+    return result;
+}
+static void load_device_routes() {
+    for (size_t i = 0; i < device_routes_size; ++i) {
+        free(device_routes[i].keys);
+    }
+    device_routes_size = 0;
+    for (size_t i = 0; i < USB_MIDI_DEVICES; ++i) {
+        device_keys[i] = &keys;
+        device_thru[i] = true;
+        device_out[i] = false;
+    }
+    if (!SD.exists("/prang.dev")) {
+        return;
+    }
+    File f = SD.open("/prang.dev", "r");
+    while (f.available() && device_routes_size < USB_MIDI_ROUTES) {
+        String line = f.readStringUntil('\n');
+        unsigned int vid, pid;
+        char name[32];
+        int thru;
+        int out = 0;
+        if (4 > sscanf(line.c_str(), "%x %x %31s %d %d", &vid, &pid, name, &thru, &out)) {
+            continue;
+        }
+        device_route& route = device_routes[device_routes_size++];
+        route.vid = (uint16_t)vid;
+        route.pid = (uint16_t)pid;
+        route.thru = thru != 0;
+        route.out = out != 0;
+        route.keys = nullptr;
+        if (0 != strcmp(name, "-")) {
+            route.keys = load_key_map(name);
+            if (route.keys == nullptr) {
+                Serial.printf("Error reading %s. Using the default map\n", name);
+            }
+        }
+    }
+    f.close();
+}
+// per track reshaping from /prang.trk, one track per line:
+//   track channel transpose [low high [velocity [curve]]]
+// track is 1 based. channel is 1-16, or 0 to keep the recorded ones.
+// transpose is in semitones, low and high are the note range kept,
+// velocity is a percentage and curve bends it
+static void load_track_transforms() {
+    if (!SD.exists("/prang.trk")) {
+        return;
+    }
+    File f = SD.open("/prang.trk", "r");
+    while (f.available()) {
+        String line = f.readStringUntil('\n');
+        int track, channel, transpose;
+        int low = 0, high = 127, velocity = 100;
+        float curve = 1.0f;
+        if (3 > sscanf(line.c_str(), "%d %d %d %d %d %d %f", &track, &channel, &transpose, &low, &high, &velocity, &curve)) {
+            continue;
+        }
+        if (track < 1 || track > (int)sampler.tracks_count() || channel < 0 || channel > 16 ||
+            low < 0 || high > 127 || low > high || velocity < 0 || curve <= 0) {
+            Serial.printf("Invalid line in prang.trk: %s\n", line.c_str());
+            continue;
+        }
+        track_transform::settings settings = track_transform::defaults();
+        settings.channel = (int8_t)(channel - 1);
+        settings.transpose = (int8_t)constrain(transpose, -127, 127);
+        settings.low_note = (uint8_t)low;
+        settings.high_note = (uint8_t)high;
+        settings.velocity_scale = (uint16_t)velocity;
+        settings.velocity_curve = curve;
+        sampler.transform(track - 1, settings);
+    }
+    f.close();
+}
+// picks the routing for a controller that just connected
+static void route_device(size_t index) {
+    char buf[32];
+    uint16_t vid = midi_in[index].idVendor();
+    uint16_t pid = midi_in[index].idProduct();
+    sprintf(buf, "%d: VID:%04X, PID:%04X", (int)index + 1, vid, pid);
+    Serial.println(buf);
+    const key_map* map = &keys;
+    bool thru = true;
+    bool out = false;
+    for (size_t i = 0; i < device_routes_size; ++i) {
+        const device_route& route = device_routes[i];
+        if (route.vid == vid && route.pid == pid) {
+            if (route.keys != nullptr) {
+                map = route.keys;
+            }
+            thru = route.thru;
+            out = route.out;
+            break;
+        }
+    }
+    device_keys[index] = map;
+    device_thru[index] = thru;
+    device_out[index] = out;
+}
+// which tracks and channels reach each port, from /prang.out:
+//   port sources channels [delay]
+// port is usb, din or host. sources is a hex mask with a bit for each
+// track, and bit 63 for thru. channels is a hex mask, bit 0 for
+// channel 1. delay holds the port back by that many microseconds.
+// thru sysex is streamed to usb as it arrives, so it isn't delayed and
+// can overtake delayed thru before it. ports not listed get
+// everything, undelayed
+static void load_output_routes() {
+    if (!SD.exists("/prang.out")) {
+        return;
+    }
+    File f = SD.open("/prang.out", "r");
+    while (f.available()) {
+        String line = f.readStringUntil('\n');
+        char port[8];
+        unsigned long long sources;
+        unsigned int channels;
+        unsigned int delay_us = 0;
+        if (3 > sscanf(line.c_str(), "%7s %llx %x %u", port, &sources, &channels, &delay_us)) {
+            continue;
+        }
+        int index;
+        if (0 == strcmp(port, "usb")) {
+            index = 0;
+        } else if (0 == strcmp(port, "din")) {
+            index = 1;
+        } else if (0 == strcmp(port, "host")) {
+            index = 2;
+        } else {
+            Serial.printf("Unknown port %s in prang.out\n", port);
+            continue;
+        }
+        router.filter(index, (uint64_t)sources, (uint16_t)channels);
+        port_delays[index]->delay(delay_us);
+    }
+    f.close();
+}
+// services the host shield and hands stamped packets to the sequencer
+void usb_task(void* state) {
     uint8_t buffer[MIDI_EVENT_PACKET_SIZE];
     uint16_t rcvd;
-    int i, j;
+    bool connected[USB_MIDI_DEVICES];
+    memset(connected, 0, sizeof(connected));
+    // the packets taken for the controllers, how far each one has
+    // read, when each last took anything or was caught up, and which
+    // have timed out. a NAKed transfer is tried again on the next pass.
+    // static to keep it off the stack
+    static uint8_t out_ring[USB_OUT_RING_SIZE][4];
+    size_t out_head = 0;
+    size_t out_read[USB_MIDI_DEVICES];
+    uint32_t out_taken[USB_MIDI_DEVICES];
+    bool out_stalled[USB_MIDI_DEVICES];
+    memset(out_read, 0, sizeof(out_read));
+    memset(out_taken, 0, sizeof(out_taken));
+    memset(out_stalled, 0, sizeof(out_stalled));
+    // the host runs one transfer at a time, so the controllers take
+    // turns. this is whose turn it is, and how many turns are left
+    // in this poll
+    size_t poll_device = 0;
+    size_t poll_left = 0;
+    int drained = 0;
+    // the SOF interrupt would hold INT low forever, since nothing
+    // clears it. only wake on connection changes and finished transfers
+    Usb.regWr(rHIEN, bmCONDETIE | bmHXFRDNIE);
+    usb_task_handle = xTaskGetCurrentTaskHandle();
+    attachInterrupt(digitalPinToInterrupt(USB_INT), usb_isr, FALLING);
+    uint32_t next_poll = millis();
+    uint32_t next_task = millis();
     while (true) {
+        // sleep until a host IRQ or the next poll is due
+        int32_t wait = (int32_t)(next_poll - millis());
+        bool irq = 0 != ulTaskNotifyTake(pdTRUE, wait > 0 ? pdMS_TO_TICKS(wait) : 0);
+        uint32_t ms = millis();
+        if ((int32_t)(ms - next_poll) >= 0) {
+            next_poll = ms + USB_POLL_INTERVAL;
+            if (poll_left == 0) {
+                poll_left = USB_MIDI_DEVICES;
+            }
+        }
+        bool pushed = false;
+        // keep draining a controller while it has data, up to a limit,
+        // then move on. each pass either finishes the IN in flight or
+        // launches the next one, and a launch comes back on HXFRDN.
+        // we stamp in the order we drain, so the merged stream stays
+        // in timestamp order
+        while (poll_left > 0) {
+            USBH_MIDI& dev = midi_in[poll_device];
+            if (dev) {
+                uint8_t r = dev.RecvDataAsync(&rcvd, buffer);
+                if (r == USB_ERROR_TRANSFER_PENDING) {
+                    break;
+                }
+                if (r == 0 && rcvd != 0) {
+                    usb_midi_event ev;
+                    ev.timestamp = midi_stats::now();
+                    ev.device = (uint8_t)poll_device;
+                    // a transfer can carry up to 16 event packets
+                    for (uint16_t i = 0; i + 4 <= rcvd; i += 4) {
+                        const uint8_t* pkt = buffer + i;
+                        if ((pkt[0] & 0x0F) < 2) {
+                            // reserved or padding
+                            continue;
+                        }
+                        memcpy(ev.packet, pkt, 4);
+                        pushed = input_ring.push(ev) || pushed;
+                    }
+                    if (++drained < 8) {
+                        continue;
+                    }
+                }
+            }
+            drained = 0;
+            --poll_left;
+            if (++poll_device == USB_MIDI_DEVICES) {
+                poll_device = 0;
+            }
+        }
+        if (pushed && midi_task_handle != nullptr) {
+            xTaskNotifyGive(midi_task_handle);
+        }
+        // the host can't start another transfer while an IN is in flight.
+        // INT is level triggered, so service it until it lets go
+        if (!midi_in[poll_device].RecvPending() &&
+            (irq || LOW == digitalRead(USB_INT) ||
+             Usb.getUsbTaskState() != USB_STATE_RUNNING ||
+             (int32_t)(ms - next_task) >= 0)) {
+            Usb.Task();
+            next_task = ms + USB_TASK_INTERVAL;
+            for (size_t i = 0; i < USB_MIDI_DEVICES; ++i) {
+                bool c = midi_in[i];
+                if (c != connected[i]) {
+                    // a backlog for a controller that's gone is moot
+                    out_read[i] = out_head;
+                    out_taken[i] = ms;
+                    out_stalled[i] = false;
+                }
+                if (c && !connected[i]) {
+                    route_device(i);
+                }
+                connected[i] = c;
+            }
+        }
+        // the same goes for OUT transfers. packets go out in transfers as
+        // big as each controller's endpoint takes, cut at packet
+        // boundaries, since not every device will reassemble an event
+        // packet split across two. each controller reads the ring at its
+        // own pace. one that takes nothing for USB_OUT_TIMEOUT is marked
+        // stalled and loses whatever it can't take straight away, until
+        // a transfer to it goes through again, so it can't hold the ring
+        if (!midi_in[poll_device].RecvPending()) {
+            bool sending[USB_MIDI_DEVICES];
+            size_t oldest = out_head;
+            for (size_t i = 0; i < USB_MIDI_DEVICES; ++i) {
+                sending[i] = device_out[i] && midi_in[i] && 0 != midi_in[i].SendEndpoint();
+                if (!sending[i]) {
+                    // keep up, so it doesn't hold the ring
+                    out_read[i] = out_head;
+                    out_taken[i] = ms;
+                } else if (out_head - out_read[i] > out_head - oldest) {
+                    oldest = out_read[i];
+                }
+            }
+            if (oldest == out_head) {
+                // nobody is behind, so the ring can start over
+                for (size_t i = 0; i < USB_MIDI_DEVICES; ++i) {
+                    out_read[i] = 0;
+                }
+                out_head = 0;
+                oldest = 0;
+            }
+            // take what fits up to the end of the ring. the rest comes
+            // around on the next pass
+            size_t room = USB_OUT_RING_SIZE - (out_head - oldest);
+            const size_t to_end = USB_OUT_RING_SIZE - (out_head & (USB_OUT_RING_SIZE - 1));
+            if (room > to_end) {
+                room = to_end;
+            }
+            if (room != 0 && !usbh_out.empty()) {
+                out_head += usbh_out.take(out_ring[out_head & (USB_OUT_RING_SIZE - 1)], room * 4) / 4;
+            }
+            for (size_t i = 0; i < USB_MIDI_DEVICES; ++i) {
+                if (!sending[i]) {
+                    continue;
+                }
+                size_t max_packets = midi_in[i].SendMaxPacketSize() / 4;
+                if (max_packets == 0) {
+                    max_packets = 1;
+                }
+                while (out_read[i] != out_head) {
+                    const size_t at = out_read[i] & (USB_OUT_RING_SIZE - 1);
+                    size_t count = out_head - out_read[i];
+                    if (count > USB_OUT_RING_SIZE - at) {
+                        count = USB_OUT_RING_SIZE - at;
+                    }
+                    if (count > max_packets) {
+                        count = max_packets;
+                    }
+                    if (0 != midi_in[i].SendRawData((uint16_t)(count * 4), out_ring[at])) {
+                        // NAKed. the rest waits for the next pass
+                        break;
+                    }
+                    out_read[i] += count;
+                    out_stalled[i] = false;
+                }
+                if (out_read[i] == out_head) {
+                    out_taken[i] = ms;
+                } else if (out_stalled[i] || (int32_t)(ms - out_taken[i]) >= USB_OUT_TIMEOUT) {
+                    out_stalled[i] = true;
+                    device_out_dropped += out_head - out_read[i];
+                    out_read[i] = out_head;
+                }
+            }
+        }
+    }
+}
+// drains input, triggers tracks and runs playback
+void midi_task(void* state) {
+    midi_task_handle = xTaskGetCurrentTaskHandle();
+    while (true) {
+        // wake on input, or every tick for playback and delayed output
+        ulTaskNotifyTake(pdTRUE, 1);
         queue_info qi;
         if (queue_to_thread.receive(&qi, false)) {
             switch (qi.cmd) {
                 case 1:
+                    // the encoder takes the tempo back from tap/follow
+                    tempo.clear();
+                    sampler.fixed_microtempo(0);
                     sampler.tempo_multiplier(qi.value);
                     break;
+                case 2:
+                    stats.clear();
+                    break;
+                case 4:
+                    // hand loop() a copy to print
+                    if (sfx_result::success == stats_view.copy(stats)) {
+                        qi.cmd = 3;
+                        queue_to_main.send(qi, false);
+                    }
+                    break;
+                case 3:
+                    if (tempo.tap(qi.timestamp)) {
+                        update_tempo_follow();
+                    }
+                    break;
                 default:
                     break;
             }
         }
-        Usb.Task();
-        if (midi_in) {
-            if (midi_in.RecvData(&rcvd, buffer) == 0) {
-                const uint8_t* p = buffer + 1;
-                last_status = *(p++);
-                int base_note = base_octave * 12;
-                bool note_on = false;
-                int note;
-                int vel;
-                //unsigned long long next_off_elapsed = 0;
-                //int next_off_track = -1;
-                queue_info qi;
-                int s = last_status;
-                if (s < 0xF0) {
-                    s &= 0xF0;
-                }
-                switch ((midi_message_type)s) {
-                    case midi_message_type::note_on:
-                        note_on = true;
-                    case midi_message_type::note_off:
-                        note = *(p++);
-                        vel = *(p++);
-                        // is the note within our captured notes?
-                        if ((last_status & 0x0F) == 0 && 
-                            note >= base_note && 
-                            note < base_note + sampler.tracks_count()) {
-                            if (note_on && vel > 0) {
-                                quantizer.start(note - base_note);
-                                qi.cmd = 1;
-                                qi.value = (int)quantizer.last_timing();
-                                queue_to_main.send(qi, false);
-                            } else {
-                                quantizer.stop(note - base_note);
-                            }
-                        } else {
-                            // just forward it
-                            tud_midi_stream_write(0, buffer + 1, 3);
-                        }
-                        break;
-                    case midi_message_type::polyphonic_pressure:
-                    case midi_message_type::control_change:
-                    case midi_message_type::pitch_wheel_change:
-                    case midi_message_type::song_position:
-                        // length 3 message - forward it
-                        tud_midi_stream_write(0, buffer + 1, 3);
-                        break;
-                    case midi_message_type::program_change:
-                    case midi_message_type::channel_pressure:
-                    case midi_message_type::song_select:
-                        // length 2 message - forward it
-                        tud_midi_stream_write(0, buffer + 1, 2);
+        uint32_t waited;
+        while (bus_wait_ring.pop(&waited)) {
+            stats.bus_wait(waited);
+        }
+        usb_midi_event ev;
+        while (input_ring.pop(&ev)) {
+            usb_midi_message msg;
+            const size_t d = ev.device;
+            if (usb_decoders[d].decode(ev.packet, &msg) &&
+                process_input(msg, *device_keys[d], ev.timestamp)) {
+                continue;
+            }
+            if (!device_thru[d]) {
+                continue;
+            }
+            const uint8_t cin = ev.packet[0] & 0x0F;
+            if (cin < 4 || cin > 7) {
+                // short messages go wherever /prang.out sends thru
+                midi_message m;
+                m.status = ev.packet[1];
+                switch (usb_midi_decoder::cin_size(cin)) {
+                    case 2:
+                        m.value8 = ev.packet[2];
                         break;
-                    case midi_message_type::system_exclusive:
-                        for (j = 2; j < sizeof(buffer); ++j) {
-                            if (buffer[j] == 0xF7) {
-                                break;
-                            }
-                        }
-                        // sysex message - forward it
-                        tud_midi_stream_write(0, buffer + 1, j);
+                    case 3:
+                        m.msb(ev.packet[2]);
+                        m.lsb(ev.packet[3]);
                         break;
-                    case midi_message_type::reset:
-                    case midi_message_type::end_system_exclusive:
-                    case midi_message_type::active_sensing:
-                    case midi_message_type::start_playback:
-                    case midi_message_type::stop_playback:
-                    case midi_message_type::tune_request:
-                    case midi_message_type::timing_clock:
-                        // length 1 message - forward it
-                        tud_midi_stream_write(0, buffer + 1, 1);
+                    default:
                         break;
                 }
+                merger.source(midi_router::thru_source).send_at(m, ev.timestamp);
+                continue;
             }
+            // the raw packets skip the merge, so what's ahead goes first
+            merger.drain();
+            // sysex (and single byte system common, which shares its
+            // codes) only goes to the computer, raw on cable 0, packet
+            // by packet without waiting for the end. that passes the
+            // usb delay by, since it can only hold whole messages
+            uint8_t packet[4];
+            packet[0] = cin;
+            packet[1] = ev.packet[1];
+            packet[2] = ev.packet[2];
+            packet[3] = ev.packet[3];
+            midi_out.send_packet(packet);
         }
         sampler.update();
-        vTaskDelay(1);
+        // everything from this pass leaves together, in time order
+        merger.flush();
     }
 }
 
-void onInit() {
-    char buf[20];
-    uint16_t vid = midi_in.idVendor();
-    uint16_t pid = midi_in.idProduct();
-    sprintf(buf, "VID:%04X, PID:%04X", vid, pid);
-    Serial.println(buf);
-}
 sfx_result scan_file(File& file, midi_file_info* out_info) {
     midi_file mf;
     file_stream fs(file);
@@ -318,29 +873,33 @@ void load_prang_font(open_font* out_font) {
             ;
     }
 }
+static void draw_tempo_text(const char* sz) {
+    open_text_info oti;
+    oti.font = &Telegrama_otf;
+    oti.scale = Telegrama_otf.scale(25);
+    oti.transparent_background = false;
+    oti.text = sz;
+    ssize16 tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), oti.text, oti.scale);
+    srect16 trc = tsz.bounds();
+    trc.offset_inplace(lcd.dimensions().width - tsz.width - 2, 2);
+    draw::filled_rectangle(display, trc.inflate(100, 0), color_t::white);
+    draw::text(display, trc, oti, color_t::black, color_t::white);
+}
 void update_tempo_mult(bool send = true) {
     if (send) {
         queue_info qi;
         qi.cmd = 1;
         qi.value = tempo_multiplier;
+        qi.timestamp = 0;
         queue_to_thread.send(qi, true);
     }
     char sz[32];
     sprintf(sz, "x%0.2f", tempo_multiplier);
-    open_text_info oti;
-    oti.font = &Telegrama_otf;
-    oti.scale = Telegrama_otf.scale(25);
-    oti.transparent_background = false;
-    oti.text = sz;
-    ssize16 tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), oti.text, oti.scale);
-    srect16 trc = tsz.bounds();
-    trc.offset_inplace(lcd.dimensions().width - tsz.width - 2, 2);
-    draw::filled_rectangle(lcd, trc.inflate(100, 0), color_t::white);
-    draw::text(lcd, trc, oti, color_t::black, color_t::white);
+    draw_tempo_text(sz);
 }
 
 static void draw_error(const char* text) {
-    draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+    draw::filled_rectangle(display, lcd.bounds(), color_t::white);
     const open_font* pf = nullptr;
     open_font prangfnt;
     const_buffer_stream cbs(prang_font_buffer, prang_font_buffer_size);
@@ -355,7 +914,7 @@ static void draw_error(const char* text) {
     float scale = pf->scale(60);
     ssize16 sz = pf->measure_text(ssize16::max(), spoint16::zero(), text, scale);
     srect16 rect = sz.bounds().center((srect16)lcd.bounds());
-    draw::text(lcd, rect, spoint16::zero(), text, *pf, scale, color_t::red, color_t::white, false);
+    draw::text(display, rect, spoint16::zero(), text, *pf, scale, color_t::red, color_t::white, false);
 }
 void wait_and_restart() {
     button_a.update();
@@ -386,7 +945,9 @@ void setup() {
     encoder_old_count = 0;
     encoder.attachFullQuad(ENC_CLK, ENC_DATA);
     SPIFFS.begin(false);
+    spi_bus.bulk_acquire();
     lcd.initialize();
+    spi_bus.bulk_release();
     open_font fnt;
     load_prang_font(&fnt);
     delay(200);
@@ -395,7 +956,7 @@ void setup() {
         delay(25);
     }
     Serial.println("SD OK");
-    lcd.fill(lcd.bounds(), color_t::red);
+    display.fill(lcd.bounds(), color_t::red);
     if (Usb.Init() == -1) {
         Serial.println("USB Host initialization failure");
         while (true)
@@ -404,15 +965,19 @@ void setup() {
     delay(200);
     midi_out.initialize("Prang MIDI Out");
     Serial.println("MIDI Out registered");
-    // Register onInit() function
-    midi_in.attachOnInit(onInit);
+    midi_din.initialize(DIN_RX, DIN_TX);
+    midi_din.backlog(DIN_BACKLOG);
+    // once only. restarting must not add the ports again
+    router.add(&usb_delay);
+    router.add(&din_delay);
+    router.add(&host_delay);
     free(prang_font_buffer);
     prang_font_buffer = nullptr;
 
 restart:
-    draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+    draw::filled_rectangle(display, lcd.bounds(), color_t::white);
     file = SPIFFS.open("/MIDI.jpg", "rb");
-    gfx_result gr = draw::image(lcd, rect16(32, 0, lcd.dimensions().width - 1, lcd.dimensions().height - 1), &file);
+    gfx_result gr = draw::image(display, rect16(32, 0, lcd.dimensions().width - 1, lcd.dimensions().height - 1), &file);
     if (gr != gfx_result::success) {
         Serial.printf("Error loading MIDI.jpg (%d)\n", (int)gr);
         while (true)
@@ -430,7 +995,7 @@ restart:
     pti.scale = scale;
     pti.text = prang_txt;
     pti.no_antialiasing = true;
-    draw::text(lcd, txt_rct, pti, color_t::red);
+    draw::text(display, txt_rct, pti, color_t::red);
     if (SD.cardSize() == 0) {
         draw_error("insert SD card");
         while (true) {
@@ -457,11 +1022,31 @@ restart:
             base_octave = file.parseInt();
             if (',' == file.read()) {
                 quantize_beats = file.parseInt();
+                if (',' == file.read()) {
+                    tap_note = file.parseInt();
+                    if (',' == file.read()) {
+                        tempo_follow = file.parseInt();
+                        if (',' == file.read()) {
+                            velocity_triggers = file.parseInt();
+                        }
+                    }
+                }
             }
             file.close();
             has_settings = true;
         }
     }
+    if (SD.exists("/prang.map")) {
+        file = SD.open("/prang.map", "r");
+        file_stream map_stream(file);
+        has_key_map = sfx_result::success == key_map::read(map_stream, &keys);
+        file.close();
+        if (!has_key_map) {
+            Serial.println("Error reading prang.map. Using the base octave");
+        }
+    }
+    load_device_routes();
+    load_output_routes();
     free(prang_font_buffer);
     prang_font_buffer = nullptr;
     file = SD.open("/", "r");
@@ -508,7 +1093,7 @@ restart:
     sprintf(loading_buf, "loading file 0 of %d", (int)fn_count);
     ssize16 loading_size = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), loading_buf, loading_scale);
     srect16 loading_rect = loading_size.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, lcd.dimensions().height - loading_size.height);
-    draw::text(lcd, loading_rect, spoint16::zero(), loading_buf, Telegrama_otf, loading_scale, color_t::blue, color_t::white, false);
+    draw::text(display, loading_rect, spoint16::zero(), loading_buf, Telegrama_otf, loading_scale, color_t::blue, color_t::white, false);
     file = SD.open("/", "r");
     char* str = fns;
     int fi = 0;
@@ -529,10 +1114,10 @@ restart:
                  0 == strcmp(".Mid", fn + fnl - 4))) {
                 ++fli;
                 sprintf(loading_buf, "loading file %d of %d", fli, (int)fn_count);
-                draw::filled_rectangle(lcd, loading_rect, color_t::white);
+                draw::filled_rectangle(display, loading_rect, color_t::white);
                 loading_size = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), loading_buf, loading_scale);
                 loading_rect = loading_size.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, lcd.dimensions().height - loading_size.height);
-                draw::text(lcd, loading_rect, spoint16::zero(), loading_buf, Telegrama_otf, loading_scale, color_t::blue, color_t::white, false);
+                draw::text(display, loading_rect, spoint16::zero(), loading_buf, Telegrama_otf, loading_scale, color_t::blue, color_t::white, false);
                 if (sfx_result::success == scan_file(f, &mfs[fi])) {
                     memcpy(str, fn, fnl + 1);
                     str += fnl + 1;
@@ -546,7 +1131,7 @@ restart:
         f.close();
     }
     file.close();
-    draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+    draw::filled_rectangle(display, lcd.bounds(), color_t::white);
 
     base_octave = 4;
     tempo_multiplier = 1.0;
@@ -561,7 +1146,7 @@ restart:
         float fscale = fnt.scale(50);
         ssize16 tsz = fnt.measure_text(ssize16::max(), spoint16::zero(), seltext, fscale);
         srect16 trc = tsz.bounds().center_horizontal((srect16)lcd.bounds());
-        draw::text(lcd, trc.offset(0, 5), spoint16::zero(), seltext, fnt, fscale, color_t::red, color_t::white, false);
+        draw::text(display, trc.offset(0, 5), spoint16::zero(), seltext, fnt, fscale, color_t::red, color_t::white, false);
         fscale = Telegrama_otf.scale(12);
         bool done = false;
         int64_t ocount = encoder.getCount() / 4;
@@ -572,19 +1157,19 @@ restart:
         while (!done) {
             tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), curfn, fscale);
             trc = tsz.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, 58);
-            draw::filled_rectangle(lcd, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
+            draw::filled_rectangle(display, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
             rgb_pixel<16> px = color_t::black;
             if (mfs[fni].type == 1) {
                 px = color_t::blue;
             } else if (mfs[fni].type != 2) {
                 px = color_t::red;
             }
-            draw::text(lcd, trc, spoint16::zero(), curfn, Telegrama_otf, fscale, px, color_t::white, false);
+            draw::text(display, trc, spoint16::zero(), curfn, Telegrama_otf, fscale, px, color_t::white, false);
             char szt[64];
             sprintf(szt, "%d tracks", (int)mfs[fni].tracks);
             tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), szt, fscale);
             trc = tsz.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, 73);
-            draw::text(lcd, trc, spoint16::zero(), szt, Telegrama_otf, fscale, color_t::black, color_t::white, false);
+            draw::text(display, trc, spoint16::zero(), szt, Telegrama_otf, fscale, color_t::black, color_t::white, false);
             int32_t mt = mfs[fni].microtempo;
             if (mt == 0) {
                 strcpy(szt, "tempo: varies");
@@ -593,8 +1178,8 @@ restart:
             }
             tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), szt, fscale);
             trc = tsz.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, 88);
-            draw::filled_rectangle(lcd, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
-            draw::text(lcd, trc, spoint16::zero(), szt, Telegrama_otf, fscale, color_t::black, color_t::white, false);
+            draw::filled_rectangle(display, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
+            draw::text(display, trc, spoint16::zero(), szt, Telegrama_otf, fscale, color_t::black, color_t::white, false);
             bool inc;
             while (ocount == (encoder.getCount() / 4)) {
                 button_a.update();
@@ -651,13 +1236,13 @@ restart:
     file_info = mfs[fni];
     ::free(fns - 1);
     ::free(mfs);
-    draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+    draw::filled_rectangle(display, lcd.bounds(), color_t::white);
     if (!has_settings) {
         static const char* oct_text = "base oct4vE";
         float fscale = fnt.scale(50);
         ssize16 tsz = fnt.measure_text(ssize16::max(), spoint16::zero(), oct_text, fscale);
         srect16 trc = tsz.bounds().center_horizontal((srect16)lcd.bounds());
-        draw::text(lcd, trc.offset(0, 5), spoint16::zero(), oct_text, fnt, fscale, color_t::red, color_t::white, false);
+        draw::text(display, trc.offset(0, 5), spoint16::zero(), oct_text, fnt, fscale, color_t::red, color_t::white, false);
         fscale = fnt.scale(50);
         bool done = false;
         int64_t ocount = encoder.getCount() / 4;
@@ -670,8 +1255,8 @@ restart:
             fscale = Telegrama_otf.scale(25);
             tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), sz, fscale);
             trc = tsz.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, 58);
-            draw::filled_rectangle(lcd, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
-            draw::text(lcd, trc, spoint16::zero(), sz, Telegrama_otf, fscale, color_t::black, color_t::white, false);
+            draw::filled_rectangle(display, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
+            draw::text(display, trc, spoint16::zero(), sz, Telegrama_otf, fscale, color_t::black, color_t::white, false);
 
             bool inc;
             while (ocount == (encoder.getCount() / 4)) {
@@ -701,12 +1286,12 @@ restart:
                 }
             }
         }
-        draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+        draw::filled_rectangle(display, lcd.bounds(), color_t::white);
         static const char* qnt_text = "qu4ntiZE";
         fscale = fnt.scale(50);
         tsz = fnt.measure_text(ssize16::max(), spoint16::zero(), qnt_text, fscale);
         trc = tsz.bounds().center_horizontal((srect16)lcd.bounds());
-        draw::text(lcd, trc.offset(0, 5), spoint16::zero(), qnt_text, fnt, fscale, color_t::red, color_t::white, false);
+        draw::text(display, trc.offset(0, 5), spoint16::zero(), qnt_text, fnt, fscale, color_t::red, color_t::white, false);
         fscale = fnt.scale(50);
         done = false;
         ocount = encoder.getCount() / 4;
@@ -723,8 +1308,8 @@ restart:
             fscale = Telegrama_otf.scale(25);
             tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), sz, fscale);
             trc = tsz.bounds().center_horizontal((srect16)lcd.bounds()).offset(0, 58);
-            draw::filled_rectangle(lcd, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
-            draw::text(lcd, trc, spoint16::zero(), sz, Telegrama_otf, fscale, color_t::black, color_t::white, false);
+            draw::filled_rectangle(display, srect16(0, trc.y1, lcd.dimensions().width - 1, trc.y2 + trc.height() + 5).inflate(100, 0), color_t::white);
+            draw::text(display, trc, spoint16::zero(), sz, Telegrama_otf, fscale, color_t::black, color_t::white, false);
 
             bool inc;
             while (ocount == (encoder.getCount() / 4)) {
@@ -754,14 +1339,14 @@ restart:
                 }
             }
         }
-        draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
+        draw::filled_rectangle(display, lcd.bounds(), color_t::white);
         static const char* save_text = "savE?";
         static const char* yes_text = "yes";
         static const char* no_text = "no";
         fscale = fnt.scale(50);
         tsz = fnt.measure_text(ssize16::max(), spoint16::zero(), save_text, fscale);
         trc = tsz.bounds().center((srect16)lcd.bounds());
-        draw::text(lcd, trc, spoint16::zero(), save_text, fnt, fscale, color_t::red, color_t::white, false);
+        draw::text(display, trc, spoint16::zero(), save_text, fnt, fscale, color_t::red, color_t::white, false);
         fscale = Telegrama_otf.scale(25);
         tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), yes_text, fscale);
         trc = tsz.bounds();
@@ -771,12 +1356,12 @@ restart:
         oti.transparent_background = false;
         oti.scale = fscale;
         oti.text = yes_text;
-        draw::text(lcd, trc, oti, color_t::black, color_t::white);
+        draw::text(display, trc, oti, color_t::black, color_t::white);
         tsz = Telegrama_otf.measure_text(ssize16::max(), spoint16::zero(), no_text, fscale);
         trc = tsz.bounds();
         oti.text = no_text;
         trc.offset_inplace(10, lcd.dimensions().height - tsz.height);
-        draw::text(lcd, trc, oti, color_t::black, color_t::white);
+        draw::text(display, trc, oti, color_t::black, color_t::white);
         int save = -1;
         while (button_a.pressed() || button_b.pressed()) {
             button_a.update();
@@ -799,7 +1384,13 @@ restart:
             File file2 = SD.open("/prang.csv", "w", true);
             file2.print(base_octave);
             file2.print(",");
-            file2.println(quantize_beats);
+            file2.print(quantize_beats);
+            file2.print(",");
+            file2.print(tap_note);
+            file2.print(",");
+            file2.print(tempo_follow);
+            file2.print(",");
+            file2.println(velocity_triggers);
             file2.close();
         }
     }
@@ -808,8 +1399,8 @@ restart:
     const char* playing_text = "pLay1nG";
     float playing_scale = fnt.scale(100);
     ssize16 playing_size = fnt.measure_text(ssize16::max(), spoint16::zero(), playing_text, playing_scale);
-    draw::filled_rectangle(lcd, lcd.bounds(), color_t::white);
-    draw::text(lcd, playing_size.bounds().center((srect16)lcd.bounds()), spoint16::zero(), playing_text, fnt, playing_scale, color_t::red, color_t::white, false);
+    draw::filled_rectangle(display, lcd.bounds(), color_t::white);
+    draw::text(display, playing_size.bounds().center((srect16)lcd.bounds()), spoint16::zero(), playing_text, fnt, playing_scale, color_t::red, color_t::white, false);
 
     free(prang_font_buffer);
     prang_font_buffer = nullptr;
@@ -853,8 +1444,43 @@ restart:
         goto restart;
     }
     quantizer.quantize_beats(quantize_beats);
+    // size the offset histograms to the quantize window
+    int32_t stats_span = sampler.timebase(0) * (quantize_beats ? quantize_beats : 1) / 2;
+    int32_t stats_mt = file_info.microtempo ? file_info.microtempo : 500000;
+    int32_t stats_usecs = (quantize_beats ? quantize_beats : 1) * stats_mt / 2;
+    if (stats_span < 1) {
+        stats_span = 1;
+    }
+    r = midi_stats::create(sampler.tracks_count(), stats_span, stats_usecs, &stats);
+    if (r == sfx_result::success) {
+        r = midi_stats::create(sampler.tracks_count(), stats_span, stats_usecs, &stats_view);
+    }
+    if (r != sfx_result::success) {
+        draw_error("file too big");
+        delay(3000);
+        goto restart;
+    }
+    quantizer.stats(&stats);
     Serial.printf("Free heap after MIDI file load: %f\n", ESP.getFreeHeap() / 1024.0);
-    sampler.output(&midi_out);
+    for (size_t i = 0; i < sampler.tracks_count(); ++i) {
+        sampler.output(i, &merger.source(i));
+    }
+    load_track_transforms();
+    // a stopped track holding this many notes on an otherwise
+    // idle channel sends All Notes Off instead of each note off.
+    // the router turns it back into note offs on a port where the
+    // player is still holding keys on that channel through thru
+    sampler.all_notes_off_threshold(16);
+    sampler.stats(&stats);
+    if (!has_key_map) {
+        int base_note = base_octave * 12;
+        int count = sampler.tracks_count();
+        if (base_note + count > 128) {
+            count = 128 - base_note;
+        }
+        keys.clear();
+        keys.set(0, base_note, key_action::momentary, 0, count);
+    }
     for (int i = 0; i < sampler.tracks_count(); ++i) {
         sampler.stop(i);
     }
@@ -862,8 +1488,10 @@ restart:
     encoder_old_count = encoder.getCount() / 4;
     update_tempo_mult(false);
     off_ts = 0;
-    midi_thread = thread::create_affinity(1 - thread::current().affinity(), midi_task, nullptr, 24, 4000);
+    midi_thread = thread::create_affinity(1 - thread::current().affinity(), midi_task, nullptr, MIDI_TASK_PRIORITY, 4000);
     midi_thread.start();
+    usb_thread = thread::create_affinity(1 - thread::current().affinity(), usb_task, nullptr, USB_TASK_PRIORITY, 4000);
+    usb_thread.start();
 }
 
 void loop() {
@@ -886,12 +1514,69 @@ void loop() {
                 default:
                     break;
             }
-            draw::filled_ellipse(lcd, rect16(point16(20, 20), 10), px);
+            draw::filled_ellipse(display, rect16(point16(20, 20), 10), px);
+        } else if (qi.cmd == 2) {
+            char sz[32];
+            sprintf(sz, "%0.1fbpm", qi.value);
+            draw_tempo_text(sz);
+        } else if (qi.cmd == 3) {
+            // the snapshot asked for by 's' or 'b'
+            if (qi.value != 0) {
+                stats_view.write_binary(serial_stream);
+            } else {
+                stats_view.write_text(serial_stream);
+                Serial.printf("input dropped: %u\r\n", (unsigned)input_ring.dropped());
+                Serial.printf("din thinned: %u, promoted: %u, dropped: %u\r\n",
+                              (unsigned)din_queue.thinned(), (unsigned)din_queue.promoted(),
+                              (unsigned)(din_queue.overruns() + midi_din.overruns()));
+                Serial.printf("host out dropped: %u, stalled: %u\r\n", (unsigned)usbh_out.overruns(),
+                              (unsigned)device_out_dropped);
+            }
+            stats_view_asked = 0;
+        }
+    }
+    // button A is tap tempo while playing
+    button_a.update();
+    if (button_a.pressed() != tap_pressed) {
+        tap_pressed = !tap_pressed;
+        if (tap_pressed) {
+            qi.cmd = 3;
+            qi.value = 0;
+            qi.timestamp = midi_stats::now();
+            queue_to_thread.send(qi, false);
+        }
+    }
+    if (Serial.available()) {
+        // s: print timing stats, b: binary stats dump, r: reset stats
+        const int ch = Serial.read();
+        switch (ch) {
+            case 's':
+            case 'b':
+                // midi_task takes a snapshot and sends it back to print.
+                // don't let it overwrite one still being printed, but
+                // ask again if the answer never came
+                if (stats_view_asked != 0 && millis() - stats_view_asked < 1000) {
+                    break;
+                }
+                stats_view_asked = millis() | 1;
+                qi.cmd = 4;
+                qi.value = ch == 'b';
+                qi.timestamp = 0;
+                queue_to_thread.send(qi, true);
+                break;
+            case 'r':
+                qi.cmd = 2;
+                qi.value = 0;
+                qi.timestamp = 0;
+                queue_to_thread.send(qi, true);
+                break;
+            default:
+                break;
         }
     }
     if (off_ts != 0 && millis() >= off_ts) {
         off_ts = 0;
-        draw::filled_ellipse(lcd, rect16(point16(20, 20), 10), color_t::white);
+        draw::filled_ellipse(display, rect16(point16(20, 20), 10), color_t::white);
     }
     bool inc;
     int64_t ec = (encoder.getCount() / 4);
@@ -0,0 +1,131 @@
+#include "midi_delay.hpp"
+#include "midi_stats.hpp"
+#include <string.h>
+using namespace sfx;
+midi_delay::midi_delay(midi_bulk_output* output) : m_output(output), m_delay(0), m_overruns(0) {
+    clear();
+}
+void midi_delay::output(midi_bulk_output* value) {
+    m_output = value;
+    clear();
+}
+void midi_delay::clear() {
+    m_head = 0;
+    m_size = 0;
+    m_sysex_head = 0;
+    m_sysex_tail = 0;
+    m_sysex_count = 0;
+}
+// the sysex is released in the order it was taken, so the space is
+// handed out like a ring, skipping the end when a message won't fit there
+bool midi_delay::allocate_sysex(size_t size, size_t* out_offset) {
+    if(m_sysex_count==0) {
+        m_sysex_head = 0;
+        m_sysex_tail = 0;
+    } else if(m_sysex_head==m_sysex_tail) {
+        return false;
+    }
+    size_t offset;
+    if(m_sysex_head>=m_sysex_tail) {
+        if(sysex_capacity-m_sysex_head>=size) {
+            offset = m_sysex_head;
+        } else if(m_sysex_tail>=size) {
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else if(m_sysex_tail-m_sysex_head>=size) {
+        offset = m_sysex_head;
+    } else {
+        return false;
+    }
+    m_sysex_head = offset+size;
+    ++m_sysex_count;
+    *out_offset = offset;
+    return true;
+}
+sfx_result midi_delay::forward(const entry& e) {
+    midi_message msg;
+    msg.status = e.status;
+    if(e.status==0xF0) {
+        // it's borrowed. don't let the destructor free it
+        msg.sysex.data = m_sysex+e.sysex_offset;
+        msg.sysex.size = e.sysex_size;
+        sfx_result r = m_output->send(msg);
+        msg.sysex.data = nullptr;
+        msg.sysex.size = 0;
+        msg.status = 0;
+        m_sysex_tail = e.sysex_offset+e.sysex_size;
+        --m_sysex_count;
+        return r;
+    }
+    switch(msg.wire_size()) {
+        case 2:
+            msg.value8 = e.data[0];
+            break;
+        case 3:
+            msg.msb(e.data[0]);
+            msg.lsb(e.data[1]);
+            break;
+        default:
+            break;
+    }
+    return m_output->send(msg);
+}
+sfx_result midi_delay::send(const midi_message& message) {
+    if(m_output==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    if(m_delay==0 && m_size==0) {
+        return m_output->send(message);
+    }
+    const int ws = message.wire_size();
+    const bool sysex = message.type()==midi_message_type::system_exclusive;
+    if(!sysex && (ws<1 || ws>3)) {
+        // meta events and the like mean nothing to an output
+        return sfx_result::success;
+    }
+    if(m_size==capacity) {
+        ++m_overruns;
+        return sfx_result::device_error;
+    }
+    entry& e = m_entries[(m_head+m_size)%capacity];
+    e.due = midi_stats::now()+m_delay;
+    e.status = message.status;
+    e.data[0] = ws==2?message.value8:(ws==3?message.msb():0);
+    e.data[1] = ws==3?message.lsb():0;
+    e.sysex_offset = 0;
+    e.sysex_size = 0;
+    if(sysex) {
+        const size_t size = message.sysex.data==nullptr?0:message.sysex.size;
+        size_t offset;
+        if(size>sysex_capacity || !allocate_sysex(size,&offset)) {
+            ++m_overruns;
+            return sfx_result::device_error;
+        }
+        if(size) {
+            memcpy(m_sysex+offset,message.sysex.data,size);
+        }
+        e.sysex_offset = (uint16_t)offset;
+        e.sysex_size = (uint16_t)size;
+    }
+    ++m_size;
+    return sfx_result::success;
+}
+sfx_result midi_delay::flush() {
+    if(m_output==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    const uint32_t now = midi_stats::now();
+    while(m_size) {
+        const entry& e = m_entries[m_head];
+        if((int32_t)(now-e.due)<0) {
+            break;
+        }
+        // the output queues for itself, so a refusal only loses this one
+        forward(e);
+        m_head = (m_head+1)%capacity;
+        --m_size;
+    }
+    return m_output->flush();
+}
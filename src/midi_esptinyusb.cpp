@@ -1,8 +1,11 @@
 #include <midiusb.h>
 #include <midi_esptinyusb.hpp>
+#include "usb_midi.hpp"
 namespace arduino {
 MIDIusb midi_esptinyusb_midi;
 bool midi_esptinyusb_initialized = false;
+midi_esptinyusb::midi_esptinyusb() : m_packets_size(0) {
+}
 bool midi_esptinyusb::initialized() const {
     return midi_esptinyusb_initialized;
 }
@@ -23,52 +26,88 @@ sfx::sfx_result midi_esptinyusb::initialize(const char* device_name) {
     }
     return sfx::sfx_result::success;
 }
+sfx::sfx_result midi_esptinyusb::write_packet(uint8_t cin, uint8_t b0, uint8_t b1, uint8_t b2) {
+    sfx::sfx_result rr = sfx::sfx_result::success;
+    if(m_packets_size==sizeof(m_packets)) {
+        rr = flush();
+    }
+    uint8_t* p = m_packets+m_packets_size;
+    p[0]=cin;
+    p[1]=b0;
+    p[2]=b1;
+    p[3]=b2;
+    m_packets_size+=4;
+    return rr;
+}
+sfx::sfx_result midi_esptinyusb::write_sysex(const sfx::midi_message& message) {
+    const size_t count = usb_midi_encoder::sysex_packets(message.sysex.data,message.sysex.size);
+    sfx::sfx_result result = sfx::sfx_result::success;
+    uint8_t p[4];
+    for(size_t i = 0;i<count;++i) {
+        usb_midi_encoder::sysex_packet(message.status,message.sysex.data,message.sysex.size,i,p);
+        sfx::sfx_result rr = write_packet(p[0],p[1],p[2],p[3]);
+        if(rr!=sfx::sfx_result::success) {
+            result = rr;
+        }
+    }
+    return result;
+}
+sfx::sfx_result midi_esptinyusb::send_packet(const uint8_t* packet) {
+    sfx::sfx_result rr = initialize();
+    if(rr!=sfx::sfx_result::success) {
+        return rr;
+    }
+    return write_packet(packet[0],packet[1],packet[2],packet[3]);
+}
+sfx::sfx_result midi_esptinyusb::flush() {
+    sfx::sfx_result rr = sfx::sfx_result::success;
+    // TinyUSB takes one packet per call, but they land in its FIFO
+    // back to back and leave in as few IN transfers as it can manage
+    for(size_t i = 0;i<m_packets_size;i+=4) {
+        if(!tud_midi_packet_write(m_packets+i)) {
+            // the FIFO is full or nobody is listening. drop the rest
+            rr = sfx::sfx_result::io_error;
+            break;
+        }
+    }
+    m_packets_size = 0;
+    return rr;
+}
 sfx::sfx_result midi_esptinyusb::send(const sfx::midi_message& message) {
     sfx::sfx_result rr = initialize();
     if(rr!=sfx::sfx_result::success) {
         return rr;
     }
-    uint8_t buf[3];
     if(message.type()==sfx::midi_message_type::meta_event && 
             (message.meta.type!=0 || message.meta.data!=nullptr)) {
         return sfx::sfx_result::success;
     }
     if (message.type()==sfx::midi_message_type::system_exclusive) {
-        // send a sysex message
-        uint8_t* p = (uint8_t*)malloc(message.sysex.size + 1);
-        if (p != nullptr) {
-            *p = message.status;
-            if(message.sysex.size) {
-                memcpy(p + 1, message.sysex.data, message.sysex.size);
-            }
-            tud_midi_stream_write(0, p, message.sysex.size + 1);
-            // write the end sysex
-            *p=0xF7;
-            tud_midi_stream_write(0, p, 1);
-            free(p);
+        return write_sysex(message);
+    }
+    const uint8_t cin = usb_midi_encoder::cin(message.status, message.wire_size());
+    switch (message.wire_size()) {
+        case 1:
+            return write_packet(cin, message.status, 0, 0);
+        case 2:
+            return write_packet(cin, message.status, message.value8, 0);
+        case 3:
+            return write_packet(cin, message.status, message.msb(), message.lsb());
+        default:
+            return sfx::sfx_result::success;
+    }
+}
+sfx::sfx_result midi_esptinyusb::send(const sfx::midi_message* messages, size_t count) {
+    sfx::sfx_result result = sfx::sfx_result::success;
+    for(size_t i = 0;i<count;++i) {
+        sfx::sfx_result rr = send(messages[i]);
+        if(rr==sfx::sfx_result::io_error) {
+            // dropped by the device stack. keep going with the rest
+            result = rr;
+        } else if(rr!=sfx::sfx_result::success) {
+            return rr;
         }
-    } else {
-        // send a regular message
-        // build a buffer and send it using raw midi
-        buf[0] = message.status;
-        switch (message.wire_size()) {
-            case 1:
-                tud_midi_stream_write(0, buf, 1);
-                break;
-            case 2:
-                buf[1] = message.value8;
-                tud_midi_stream_write(0, buf, 2);
-                break;
-            case 3:
-                buf[1] = message.msb();
-                buf[2] = message.lsb();
-                tud_midi_stream_write(0, buf, 3);
-                break;
-            default:
-                break;
-        }            
     }
-    return sfx::sfx_result::success;
+    return result;
 }
 }
-
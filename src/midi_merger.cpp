@@ -0,0 +1,114 @@
+#include "midi_merger.hpp"
+using namespace sfx;
+// what a message must stay behind: its channel, or 16 for the rest
+static uint8_t order_key(uint8_t status) {
+    return status<0xF0?(status&0x0F):16;
+}
+sfx_result midi_merger::input::send(const midi_message& message) {
+    if(m_merger==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    return m_merger->queue(m_index,message,m_merger->m_clock());
+}
+sfx_result midi_merger::input::send_at(const midi_message& message, uint32_t timestamp) {
+    if(m_merger==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    return m_merger->queue(m_index,message,timestamp);
+}
+sfx_result midi_merger::input::flush() {
+    if(m_merger==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    return m_merger->flush();
+}
+midi_merger::midi_merger(midi_router* router, uint32_t (*clock)()) : m_router(router), m_clock(clock), m_size(0) {
+    for(size_t i = 0;i<max_sources;++i) {
+        m_inputs[i].m_merger = this;
+        m_inputs[i].m_index = i;
+    }
+}
+midi_bulk_output& midi_merger::source(size_t index) {
+    if(index>=max_sources) {
+        index = max_sources-1;
+    }
+    return m_inputs[index];
+}
+sfx_result midi_merger::queue(size_t source, const midi_message& message, uint32_t timestamp) {
+    if(m_router==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    const int ws = message.wire_size();
+    if(message.type()==midi_message_type::system_exclusive ||
+            message.type()==midi_message_type::meta_event ||
+            ws<1 || ws>3) {
+        // these aren't copied. send what's ahead of them, then them
+        drain();
+        return m_router->source(source).send(message);
+    }
+    if(m_size==capacity) {
+        // better early than dropped
+        drain();
+    }
+    const uint8_t key = order_key(message.status);
+    // walk back past anything due later, but never past the
+    // last message from the same source on the same channel
+    size_t i = m_size;
+    while(i>0) {
+        const entry& prev = m_entries[i-1];
+        if(prev.source==source && order_key(prev.status)==key) {
+            break;
+        }
+        if((int32_t)(prev.timestamp-timestamp)<=0) {
+            break;
+        }
+        --i;
+    }
+    for(size_t j = m_size;j>i;--j) {
+        m_entries[j]=m_entries[j-1];
+    }
+    entry& e = m_entries[i];
+    e.timestamp = timestamp;
+    e.source = (uint8_t)source;
+    e.status = message.status;
+    e.data[0] = ws==2?message.value8:(ws==3?message.msb():0);
+    e.data[1] = ws==3?message.lsb():0;
+    ++m_size;
+    return sfx_result::success;
+}
+sfx_result midi_merger::drain() {
+    if(m_router==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    sfx_result result = sfx_result::success;
+    for(size_t i = 0;i<m_size;++i) {
+        const entry& e = m_entries[i];
+        midi_message msg;
+        msg.status = e.status;
+        switch(msg.wire_size()) {
+            case 2:
+                msg.value8 = e.data[0];
+                break;
+            case 3:
+                msg.msb(e.data[0]);
+                msg.lsb(e.data[1]);
+                break;
+            default:
+                break;
+        }
+        sfx_result r = m_router->source(e.source).send(msg);
+        if(r!=sfx_result::success && result==sfx_result::success) {
+            result = r;
+        }
+    }
+    m_size = 0;
+    return result;
+}
+sfx_result midi_merger::flush() {
+    sfx_result result = drain();
+    if(m_router==nullptr) {
+        return result;
+    }
+    sfx_result r = m_router->flush();
+    return result==sfx_result::success?r:result;
+}
@@ -3,6 +3,7 @@ using namespace sfx;
 midi_quantizer::midi_quantizer(midi_quantizer&& rhs) {
     m_sampler = rhs.m_sampler;
     rhs.m_sampler = nullptr;
+    m_stats = rhs.m_stats;
     m_deallocator = rhs.m_deallocator;
     rhs.m_deallocator = nullptr;
     m_follow_key = rhs.m_follow_key;
@@ -15,6 +16,7 @@ midi_quantizer& midi_quantizer::operator=(midi_quantizer&& rhs) {
     deallocate();
     m_sampler = rhs.m_sampler;
     rhs.m_sampler = nullptr;
+    m_stats = rhs.m_stats;
     m_deallocator = rhs.m_deallocator;
     rhs.m_deallocator = nullptr;
     m_follow_key = rhs.m_follow_key;
@@ -34,6 +36,7 @@ void midi_quantizer::deallocate() {
 }
 sfx_result midi_quantizer::create(midi_sampler& sampler,midi_quantizer* out_quantizer, void*(*allocator)(size_t),void(*deallocator)(void*)) {
     out_quantizer->m_sampler = &sampler;
+    out_quantizer->m_stats = nullptr;
     out_quantizer->m_deallocator = deallocator;
     out_quantizer->m_quantize_beats = 4;
     out_quantizer->m_follow_key = -1;
@@ -52,13 +55,13 @@ void midi_quantizer::quantize_beats(int value) {
     }
     m_quantize_beats = value;
 }
-sfx_result midi_quantizer::start(size_t index) {
+sfx_result midi_quantizer::start(size_t index, uint32_t timestamp) {
     if(m_sampler==nullptr || 
             index<0||
             index>=m_sampler->tracks_count()) {
         return sfx_result::invalid_argument;
     }
-    m_last_key_ticks = m_sampler->elapsed(index);
+    m_last_key_ticks = timestamp?m_sampler->elapsed(index,timestamp):m_sampler->elapsed(index);
     if(!m_quantize_beats || m_follow_key==-1) {
         m_sampler->start(index);
         m_key_advance[index]=0;
@@ -70,7 +73,12 @@ sfx_result midi_quantizer::start(size_t index) {
     unsigned long long adv=0;
     int tb = m_sampler->timebase(m_follow_key) 
                 * m_quantize_beats;
-    smp_elapsed=m_sampler->elapsed(m_follow_key)
+    // judge the key by where the follow track was when it arrived,
+    // not when we got around to it
+    const unsigned long long now_elapsed = m_sampler->elapsed(m_follow_key);
+    const unsigned long long key_elapsed = timestamp?
+        m_sampler->elapsed(m_follow_key,timestamp):now_elapsed;
+    smp_elapsed=key_elapsed
                 - m_key_advance[m_follow_key];
     adv= smp_elapsed % tb;
     unsigned long long adv2=adv-tb;
@@ -79,8 +87,17 @@ sfx_result midi_quantizer::start(size_t index) {
         m_last_timing = midi_quantizer_timing::early;
     } else if(adv!=0) {
         m_last_timing = midi_quantizer_timing::late;
+    } else {
+        m_last_timing = midi_quantizer_timing::exact;
+    }
+    if(m_stats!=nullptr) {
+        const int32_t ticks = (int32_t)(long long)adv;
+        m_stats->hit(ticks,(int32_t)((long long)ticks*
+            m_sampler->microtempo(m_follow_key)/
+            m_sampler->timebase(m_follow_key)));
     }
-    sfx_result r = m_sampler->start(index,adv);
+    // then catch up with however far the follow track has moved since
+    sfx_result r = m_sampler->start(index,(long long)adv+(long long)(now_elapsed-key_elapsed));
     if(r!=sfx_result::success) {
         return r;
     }
@@ -0,0 +1,145 @@
+#include "midi_router.hpp"
+#include <string.h>
+using namespace sfx;
+static uint64_t source_bit(size_t index) {
+    if(index>=midi_router::max_sources) {
+        index = midi_router::max_sources-1;
+    }
+    return uint64_t(1)<<index;
+}
+sfx_result midi_router::input::send(const midi_message& message) {
+    if(m_router==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    return m_router->route(source_bit(m_index),message);
+}
+sfx_result midi_router::input::flush() {
+    if(m_router==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    return m_router->flush();
+}
+midi_router::midi_router() : m_destinations_size(0) {
+    for(size_t i = 0;i<max_sources;++i) {
+        m_inputs[i].m_router = this;
+        m_inputs[i].m_index = i;
+    }
+}
+int midi_router::add(midi_bulk_output* output, uint64_t sources, uint16_t channels) {
+    if(output==nullptr || m_destinations_size==max_destinations) {
+        return -1;
+    }
+    destination& d = m_destinations[m_destinations_size];
+    d.output = output;
+    d.sources = sources;
+    d.channels = channels;
+    memset(d.notes,0,sizeof(d.notes));
+    memset(d.held,0,sizeof(d.held));
+    return (int)m_destinations_size++;
+}
+sfx_result midi_router::filter(size_t index, uint64_t sources, uint16_t channels) {
+    if(index>=m_destinations_size) {
+        return sfx_result::invalid_argument;
+    }
+    destination& d = m_destinations[index];
+    d.sources = sources;
+    d.channels = channels;
+    return sfx_result::success;
+}
+midi_bulk_output& midi_router::source(size_t index) {
+    if(index>=max_sources) {
+        index = max_sources-1;
+    }
+    return m_inputs[index];
+}
+// sends note offs for the notes on a channel that thru isn't holding
+sfx_result midi_router::release(destination& d, uint8_t channel) {
+    sfx_result result = sfx_result::success;
+    midi_message msg;
+    msg.status = uint8_t(0x80|channel);
+    msg.lsb(0);
+    for(int w = 0;w<2;++w) {
+        uint64_t bits = d.notes[channel][w]&~d.held[channel][w];
+        d.notes[channel][w]&=~bits;
+        for(int b = 0;bits!=0;++b,bits>>=1) {
+            if(0==(bits&1)) {
+                continue;
+            }
+            msg.msb(uint8_t(w*64+b));
+            sfx_result r = d.output->send(msg);
+            if(r!=sfx_result::success && result==sfx_result::success) {
+                result = r;
+            }
+        }
+    }
+    return result;
+}
+sfx_result midi_router::route(uint64_t source_bit, const midi_message& message) {
+    sfx_result result = sfx_result::success;
+    const bool channel_message = message.status>=0x80 && message.status<0xF0;
+    const uint8_t c = channel_message?message.channel():0;
+    const midi_message_type t = message.type();
+    const bool note_on = t==midi_message_type::note_on && message.lsb()!=0;
+    const bool note_off = t==midi_message_type::note_off || 
+        (t==midi_message_type::note_on && message.lsb()==0);
+    // all sound off and all notes off
+    const bool all_off = t==midi_message_type::control_change && 
+        (message.msb()==120 || message.msb()==123);
+    const uint8_t n = message.msb()&0x7F;
+    const uint64_t note_bit = uint64_t(1)<<(n&63);
+    const bool thru = source_bit==(uint64_t(1)<<thru_source);
+    for(size_t i = 0;i<m_destinations_size;++i) {
+        destination& d = m_destinations[i];
+        bool pass = 0!=(d.sources&source_bit) && 
+            (!channel_message || 0!=(d.channels&(1<<c)));
+        if(note_off) {
+            // wherever the note on went, and nowhere else
+            pass = 0!=(d.notes[c][n>>6]&note_bit);
+            d.notes[c][n>>6]&=~note_bit;
+            d.held[c][n>>6]&=~note_bit;
+        } else if(all_off) {
+            if(!thru && (d.held[c][0]|d.held[c][1])) {
+                // the player still has keys down here
+                sfx_result r = release(d,c);
+                if(r!=sfx_result::success && result==sfx_result::success) {
+                    result = r;
+                }
+                continue;
+            }
+            if(d.notes[c][0]|d.notes[c][1]) {
+                pass = true;
+                d.notes[c][0]=0;
+                d.notes[c][1]=0;
+                d.held[c][0]=0;
+                d.held[c][1]=0;
+            }
+        } else if(note_on && pass) {
+            d.notes[c][n>>6]|=note_bit;
+            if(thru) {
+                d.held[c][n>>6]|=note_bit;
+            }
+        }
+        if(!pass) {
+            continue;
+        }
+        // a refusal only costs that output the message
+        sfx_result r = d.output->send(message);
+        if(r!=sfx_result::success && result==sfx_result::success) {
+            result = r;
+        }
+    }
+    return result;
+}
+sfx_result midi_router::send(const midi_message& message) {
+    return route(~uint64_t(0),message);
+}
+sfx_result midi_router::flush() {
+    sfx_result result = sfx_result::success;
+    for(size_t i = 0;i<m_destinations_size;++i) {
+        sfx_result r = m_destinations[i].output->flush();
+        if(r!=sfx_result::success && result==sfx_result::success) {
+            result = r;
+        }
+    }
+    return result;
+}
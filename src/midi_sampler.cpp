@@ -1,7 +1,14 @@
 #include "midi_sampler.hpp"
+#include <new>
 #include <sfx_midi_stream.hpp>
 #include <sfx_midi_file.hpp>
 using namespace sfx;
+int32_t midi_sampler::effective_microtempo(const track& t) {
+    if(t.fixed_microtempo!=0) {
+        return t.fixed_microtempo;
+    }
+    return t.base_microtempo/t.tempo_multiplier;
+}
 void midi_sampler::callback(uint32_t pending,
         unsigned long long elapsed, 
         void* pstate) {
@@ -23,13 +30,36 @@ void midi_sampler::callback(uint32_t pending,
                     t->event.message.meta.data[2];
                 // update the clock microtempo
                 t->base_microtempo = mt;
-                t->clock.microtempo(mt/t->tempo_multiplier);
+                t->clock.microtempo(effective_microtempo(*t));
             }
         }
-        else if(t->event.message.status!=0) {    
-            t->tracker.process(t->event.message);
-            if(t->output!=nullptr) {
-                t->output->send(t->event.message);
+        else if(t->event.message.status!=0 &&
+                !(t->muted && (t->event.message.type()==midi_message_type::note_on ||
+                    t->event.message.type()==midi_message_type::note_off))) {
+            // voices and channels are tracked as they leave,
+            // so releases still match if the transform changes
+            midi_message shaped;
+            const midi_message* msg = t->transform.shape(t->event.message,&shaped);
+            if(msg!=nullptr && t->voices->process(t->index,*msg) && 
+                    t->output!=nullptr) {
+                const uint32_t ts = midi_stats::now();
+                // how many ticks behind schedule we are, in microseconds
+                const uint32_t late = (uint32_t)((elapsed-t->event.absolute)*
+                    t->clock.microtempo()/t->clock.timebase());
+                // stamped with when it should have gone, so it can be
+                // put in order with what else is going out
+                t->output->send_at(*msg,ts-late);
+                t->channels->process(*msg);
+                if(msg->status<0xF0) {
+                    t->touched|=(1<<msg->channel());
+                }
+                if(t->stats!=nullptr) {
+                    t->stats->lateness(late);
+                    if(msg->type()==midi_message_type::note_on &&
+                            msg->lsb()!=0) {
+                        t->stats->note(t->index,ts);
+                    }
+                }
             }
         }
         bool restarted = false;
@@ -40,12 +70,10 @@ void midi_sampler::callback(uint32_t pending,
             t->event.message.~midi_message();
             t->event.message.status=0;
             t->clock.stop();
-            t->clock.microtempo(t->base_microtempo/t->tempo_multiplier);
+            t->clock.microtempo(effective_microtempo(*t));
             t->clock.start();
             restarted = true;
-            if(t->output!=nullptr) {
-                t->tracker.send_off(*t->output);
-            }
+            t->voices->release(t->index,t->output);
         }
 
         const_buffer_stream cbs(t->buffer,t->buffer_size);
@@ -74,9 +102,19 @@ void midi_sampler::deallocate() {
             m_tracks = nullptr;
             m_tracks_size = 0;
         }
+        if(m_voices!=nullptr) {
+            m_voices->~voice_table();
+            m_deallocator(m_voices);
+            m_voices = nullptr;
+        }
+        if(m_channels!=nullptr) {
+            m_channels->~channel_tracker();
+            m_deallocator(m_channels);
+            m_channels = nullptr;
+        }
     }
 }
-midi_sampler::midi_sampler() : m_allocator(nullptr),m_deallocator(nullptr),m_tracks_size(0),m_tracks(nullptr){
+midi_sampler::midi_sampler() : m_allocator(nullptr),m_deallocator(nullptr),m_tracks_size(0),m_tracks(nullptr),m_voices(nullptr),m_channels(nullptr){
 
 }
 midi_sampler::midi_sampler(midi_sampler&& rhs) {
@@ -84,6 +122,8 @@ midi_sampler::midi_sampler(midi_sampler&& rhs) {
     m_deallocator = rhs.m_deallocator;
     m_tracks_size = rhs.m_tracks_size;
     m_tracks = rhs.m_tracks;
+    m_voices = rhs.m_voices;
+    m_channels = rhs.m_channels;
     rhs.m_deallocator = nullptr;
 }
 midi_sampler& midi_sampler::operator=(midi_sampler&& rhs) {
@@ -92,6 +132,8 @@ midi_sampler& midi_sampler::operator=(midi_sampler&& rhs) {
     m_deallocator = rhs.m_deallocator;
     m_tracks_size = rhs.m_tracks_size;
     m_tracks = rhs.m_tracks;
+    m_voices = rhs.m_voices;
+    m_channels = rhs.m_channels;
     rhs.m_deallocator = nullptr;
     return *this;
 }
@@ -110,8 +152,30 @@ sfx_result midi_sampler::read(stream& in,midi_sampler* out_sampler,void*(allocat
     if(res!=sfx_result::success) {
         return res;
     }
+    if(file.tracks_size>voice_table::max_owners) {
+        // the voice table can't tell more tracks apart than this
+        return sfx_result::out_of_memory;
+    }
+    // one voice table is shared by all the tracks
+    void* voices_mem = allocator(sizeof(voice_table));
+    if(voices_mem==nullptr) {
+        return sfx_result::out_of_memory;
+    }
+    voice_table* voices = new(voices_mem) voice_table();
+    // so is the channel state
+    void* channels_mem = allocator(sizeof(channel_tracker));
+    if(channels_mem==nullptr) {
+        voices->~voice_table();
+        deallocator(voices);
+        return sfx_result::out_of_memory;
+    }
+    channel_tracker* channels = new(channels_mem) channel_tracker();
     track *tracks = (track*)allocator(sizeof(track)*file.tracks_size);
     if(tracks==nullptr) {
+        channels->~channel_tracker();
+        deallocator(channels);
+        voices->~voice_table();
+        deallocator(voices);
         return sfx_result::out_of_memory;
     }
     for(int i = 0;i<file.tracks_size;++i) {
@@ -132,6 +196,7 @@ sfx_result midi_sampler::read(stream& in,midi_sampler* out_sampler,void*(allocat
             goto free_all;
         }
         t.tempo_multiplier = 1.0;
+        t.fixed_microtempo = 0;
         t.base_microtempo = 500000;
         t.clock.timebase(file.timebase);
         t.clock.microtempo(500000);
@@ -142,10 +207,19 @@ sfx_result midi_sampler::read(stream& in,midi_sampler* out_sampler,void*(allocat
         t.event.message.status = 0;
         t.event.absolute = 0;
         t.output = nullptr;
+        t.voices = voices;
+        t.channels = channels;
+        t.touched = 0;
+        t.muted = false;
+        new(&t.transform) track_transform();
+        t.stats = nullptr;
+        t.index = i;
     }
     out_sampler->m_allocator = allocator;
     out_sampler->m_deallocator = deallocator;
     out_sampler->m_tracks = tracks;
+    out_sampler->m_voices = voices;
+    out_sampler->m_channels = channels;
     out_sampler->m_tracks_size = file.tracks_size;
     return sfx_result::success;
 free_all:
@@ -158,6 +232,10 @@ free_all:
         }
         deallocator(tracks);
     }
+    channels->~channel_tracker();
+    deallocator(channels);
+    voices->~voice_table();
+    deallocator(voices);
     return res;
 }
 sfx_result midi_sampler::update() {
@@ -167,11 +245,32 @@ sfx_result midi_sampler::update() {
     }
     return sfx_result::success;
 }
-void midi_sampler::output(midi_output* value) {
+void midi_sampler::output(midi_bulk_output* value) {
     for(size_t i = 0;i<m_tracks_size;++i) {
         m_tracks[i].output = value;
     }
 }
+void midi_sampler::output(size_t index, midi_bulk_output* value) {
+    if(0>index || index>=m_tracks_size) {
+        return;
+    }
+    m_tracks[index].output = value;
+}
+void midi_sampler::all_notes_off_threshold(size_t value) {
+    if(m_voices!=nullptr) {
+        m_voices->all_notes_off_threshold(value);
+    }
+}
+void midi_sampler::channel_baseline(const midi_context* value) {
+    if(m_channels!=nullptr) {
+        m_channels->baseline(value);
+    }
+}
+void midi_sampler::stats(midi_stats* value) {
+    for(size_t i = 0;i<m_tracks_size;++i) {
+        m_tracks[i].stats = value;
+    }
+}
 bool midi_sampler::started(size_t index) const {
     if(0>index || index>=m_tracks_size) {
         return false;
@@ -209,14 +308,24 @@ sfx_result midi_sampler::start(size_t index, long long advance) {
                 int32_t mt = (t.event.message.meta.data[0] << 16) | (t.event.message.meta.data[1] << 8) | t.event.message.meta.data[2];
                 // update the clock microtempo
                 t.base_microtempo = mt;
-                t.clock.microtempo(mt/t.tempo_multiplier);
+                t.clock.microtempo(effective_microtempo(t));
             } else if(t.output!=nullptr) {
                 switch(t.event.message.type()) {
                     case midi_message_type::program_change:
                     case midi_message_type::control_change:
                     case midi_message_type::system_exclusive:
-                    case midi_message_type::end_system_exclusive:
-                        t.output->send(t.event.message);
+                    case midi_message_type::end_system_exclusive: {
+                        midi_message shaped;
+                        const midi_message* msg = t.transform.shape(t.event.message,&shaped);
+                        if(msg==nullptr) {
+                            break;
+                        }
+                        t.output->send(*msg);
+                        t.channels->process(*msg);
+                        if(msg->status<0xF0) {
+                            t.touched|=(1<<msg->channel());
+                        }
+                    }
                     break;
                 default:
                     break;
@@ -242,10 +351,19 @@ sfx_result midi_sampler::stop(size_t index) {
     t.event.message.~midi_message();
     t.event.message.status = 0;
     t.base_microtempo = 500000;
-    t.clock.microtempo(t.base_microtempo/t.tempo_multiplier);
-    if(t.output!=nullptr) {
-        t.tracker.send_off(*t.output);
+    t.clock.microtempo(effective_microtempo(t));
+    t.voices->release(t.index,t.output);
+    if(t.touched!=0 && t.output!=nullptr) {
+        // leave alone channels other playing tracks are using
+        uint16_t busy = 0;
+        for(size_t i = 0;i<m_tracks_size;++i) {
+            if(i!=index && m_tracks[i].clock.started()) {
+                busy|=m_tracks[i].touched;
+            }
+        }
+        t.channels->reset(t.touched&~busy,*t.output);
     }
+    t.touched = 0;
     return sfx_result::success;
 }
 void midi_sampler::tempo_multiplier(float value) {
@@ -255,16 +373,85 @@ void midi_sampler::tempo_multiplier(float value) {
     for(size_t i = 0;i<m_tracks_size;++i) {
         track& t = m_tracks[i];
         t.tempo_multiplier = value;
-        t.clock.microtempo(t.base_microtempo/value);
+        t.clock.microtempo(effective_microtempo(t));
     }
 }
+void midi_sampler::fixed_microtempo(int32_t value) {
+    if(value<0) {
+        return;
+    }
+    for(size_t i = 0;i<m_tracks_size;++i) {
+        track& t = m_tracks[i];
+        t.fixed_microtempo = value;
+        t.clock.microtempo(effective_microtempo(t));
+    }
+}
+bool midi_sampler::muted(size_t index) const {
+    if(0>index || index>=m_tracks_size) {
+        return false;
+    }
+    return m_tracks[index].muted;
+}
+sfx_result midi_sampler::mute(size_t index, bool value) {
+    if(0>index || index>=m_tracks_size) {
+        return sfx_result::invalid_argument;
+    }
+    track& t = m_tracks[index];
+    if(value && !t.muted) {
+        // the notes it was holding would never see their note offs
+        t.voices->release(t.index,t.output);
+    }
+    t.muted = value;
+    return sfx_result::success;
+}
+sfx_result midi_sampler::transform(size_t index, const track_transform::settings& value) {
+    if(0>index || index>=m_tracks_size) {
+        return sfx_result::invalid_argument;
+    }
+    track& t = m_tracks[index];
+    // what's sounding was shaped the old way
+    t.voices->release(t.index,t.output);
+    t.transform.set(value);
+    return sfx_result::success;
+}
+sfx_result midi_sampler::dynamics(size_t index, uint8_t velocity) {
+    if(0>index || index>=m_tracks_size) {
+        return sfx_result::invalid_argument;
+    }
+    m_tracks[index].transform.dynamics(velocity);
+    return sfx_result::success;
+}
+const track_transform::settings* midi_sampler::transform(size_t index) const {
+    if(0>index || index>=m_tracks_size) {
+        return nullptr;
+    }
+    return &m_tracks[index].transform.current();
+}
 unsigned long long midi_sampler::elapsed(size_t index) const {
     if(0>index || index>=m_tracks_size) {
         return 0 ;
     }
     return m_tracks[index].clock.elapsed();
 }
-
+unsigned long long midi_sampler::elapsed(size_t index, uint32_t timestamp) const {
+    if(0>index || index>=m_tracks_size) {
+        return 0 ;
+    }
+    const track& t = m_tracks[index];
+    const unsigned long long result = t.clock.elapsed();
+    const int32_t usecs = (int32_t)(midi_stats::now()-timestamp);
+    if(usecs<=0 || !t.clock.started() || t.clock.microtempo()<=0) {
+        return result;
+    }
+    const unsigned long long ticks = (unsigned long long)usecs*t.clock.timebase()/t.clock.microtempo();
+    return ticks>result?0:result-ticks;
+}
+int32_t midi_sampler::microtempo(size_t index) const {
+    if(0>index || index>=m_tracks_size) {
+        return 0 ;
+    }
+    return m_tracks[index].clock.microtempo();
+}
 int16_t midi_sampler::timebase(size_t index) const {
     if(0>index || index>=m_tracks_size) {
         return 0 ;
@@ -0,0 +1,259 @@
+#include "midi_scheduler.hpp"
+#include <string.h>
+using namespace sfx;
+// values where only the latest matters. everything that sets state
+// for what follows stays ordered: bank select must land before its
+// program change, data entry and (N)RPN selection are sequences, and
+// the switch pedals and channel mode messages must stay in order with
+// the notes
+static bool continuous(uint8_t status, uint8_t data1) {
+    switch(status&0xF0) {
+        case 0xA0: // polyphonic pressure
+        case 0xD0: // channel pressure
+        case 0xE0: // pitch wheel
+            return true;
+        case 0xB0:
+            return !(data1==0 || data1==32 || // bank select
+                data1==6 || data1==38 || // data entry
+                (data1>=64 && data1<=69) || // switch pedals
+                (data1>=96 && data1<=101) || // increment, decrement and (N)RPN
+                data1>=120); // channel mode
+        default:
+            return false;
+    }
+}
+// whether two continuous messages set the same value
+static bool same_target(uint8_t status, uint8_t data1, const uint8_t* other) {
+    if(status!=other[0]) {
+        return false;
+    }
+    const uint8_t t = status&0xF0;
+    return (t!=0xA0 && t!=0xB0) || data1==other[1];
+}
+static bool is_note_off(const uint8_t* message) {
+    const uint8_t t = message[0]&0xF0;
+    return t==0x80 || (t==0x90 && message[2]==0);
+}
+// whether two messages must keep their relative order. system common
+// has no channel, so it stays in order with everything
+static bool same_channel(uint8_t status, uint8_t other) {
+    return status>=0xF0 || other>=0xF0 || (status&0x0F)==(other&0x0F);
+}
+static bool earlier(uint32_t order, uint32_t other) {
+    return (int32_t)(order-other)<0;
+}
+midi_scheduler::midi_scheduler(midi_bulk_output* output) : m_output(output), m_order(0), m_thinned(0), m_overruns(0), m_promoted(0) {
+    clear();
+}
+void midi_scheduler::output(midi_bulk_output* value) {
+    m_output = value;
+    clear();
+}
+void midi_scheduler::clear() {
+    m_realtime_size = 0;
+    m_ordered_size = 0;
+    m_continuous_size = 0;
+}
+void midi_scheduler::remove(short_message* messages, size_t* size, size_t index) {
+    --*size;
+    if(index<*size) {
+        memmove(messages+index,messages+index+1,(*size-index)*sizeof(short_message));
+    }
+}
+sfx_result midi_scheduler::forward(const short_message& message) {
+    midi_message msg;
+    msg.status = message.status;
+    switch(msg.wire_size()) {
+        case 2:
+            msg.value8 = message.data[0];
+            break;
+        case 3:
+            msg.msb(message.data[0]);
+            msg.lsb(message.data[1]);
+            break;
+        default:
+            break;
+    }
+    return m_output->send(msg);
+}
+bool midi_scheduler::ordered_after(uint8_t status, uint32_t order) const {
+    for(size_t i = 0;i<m_ordered_size;++i) {
+        const short_message& msg = m_ordered[i];
+        if(earlier(order,msg.order) && same_channel(status,msg.status)) {
+            return true;
+        }
+    }
+    return false;
+}
+bool midi_scheduler::continuous_before(uint8_t status) const {
+    for(size_t i = 0;i<m_continuous_size;++i) {
+        if(same_channel(status,m_continuous[i].status)) {
+            return true;
+        }
+    }
+    return false;
+}
+// sends the controller values on the message's channel that were queued
+// before it, so a bend or mod reset lands before the note after it
+sfx_result midi_scheduler::release(const short_message& message) {
+    size_t i = 0;
+    while(i<m_continuous_size) {
+        const short_message& msg = m_continuous[i];
+        if(earlier(msg.order,message.order) && same_channel(message.status,msg.status)) {
+            sfx_result r = forward(msg);
+            if(r!=sfx_result::success) {
+                return r;
+            }
+            remove(m_continuous,&m_continuous_size,i);
+            continue;
+        }
+        ++i;
+    }
+    return sfx_result::success;
+}
+sfx_result midi_scheduler::drain() {
+    sfx_result r;
+    while(m_realtime_size) {
+        short_message msg;
+        msg.status = m_realtime[0];
+        r = forward(msg);
+        if(r!=sfx_result::success) {
+            return r;
+        }
+        --m_realtime_size;
+        memmove(m_realtime,m_realtime+1,m_realtime_size);
+    }
+    if(m_ordered_size) {
+        // note offs may jump the queue unless their note on is still
+        // waiting, or something else on the channel is ahead of them
+        uint64_t waiting[16][2];
+        uint16_t blocked = 0;
+        memset(waiting,0,sizeof(waiting));
+        size_t i = 0;
+        while(i<m_ordered_size) {
+            const short_message& msg = m_ordered[i];
+            const uint8_t c = msg.status&0x0F;
+            const uint8_t n = msg.data[0]&0x7F;
+            const uint64_t bit = uint64_t(1)<<(n&63);
+            if(msg.status>=0xF0) {
+                // system common holds up everything behind it
+                blocked = 0xFFFF;
+            } else if(is_note_off(&msg.status)) {
+                if(i>0 && 0==(blocked&(1<<c)) && 0==(waiting[c][n>>6]&bit)) {
+                    r = forward(msg);
+                    if(r!=sfx_result::success) {
+                        return r;
+                    }
+                    ++m_promoted;
+                    remove(m_ordered,&m_ordered_size,i);
+                    continue;
+                }
+            } else if((msg.status&0xF0)==0x90) {
+                waiting[c][n>>6]|=bit;
+            } else {
+                blocked|=(1<<c);
+            }
+            ++i;
+        }
+        while(m_ordered_size) {
+            r = release(m_ordered[0]);
+            if(r!=sfx_result::success) {
+                return r;
+            }
+            r = forward(m_ordered[0]);
+            if(r!=sfx_result::success) {
+                return r;
+            }
+            remove(m_ordered,&m_ordered_size,0);
+        }
+    }
+    while(m_continuous_size) {
+        r = forward(m_continuous[0]);
+        if(r!=sfx_result::success) {
+            return r;
+        }
+        remove(m_continuous,&m_continuous_size,0);
+    }
+    return sfx_result::success;
+}
+sfx_result midi_scheduler::send(const midi_message& message) {
+    if(m_output==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    const int ws = message.wire_size();
+    if(message.type()==midi_message_type::system_exclusive ||
+            message.type()==midi_message_type::meta_event ||
+            ws<1 || ws>3) {
+        // these aren't held here. let them by once the ordered
+        // traffic ahead of them has gone
+        drain();
+        if(m_ordered_size) {
+            ++m_overruns;
+            return sfx_result::device_error;
+        }
+        return m_output->send(message);
+    }
+    short_message msg;
+    msg.status = message.status;
+    msg.data[0] = ws==2?message.value8:(ws==3?message.msb():0);
+    msg.data[1] = ws==3?message.lsb():0;
+    msg.order = m_order;
+    if(msg.status>=0xF8) {
+        if(m_realtime_size==0 && m_output->send(message)==sfx_result::success) {
+            return sfx_result::success;
+        }
+        if(m_realtime_size==realtime_capacity) {
+            ++m_overruns;
+            return sfx_result::device_error;
+        }
+        m_realtime[m_realtime_size++]=msg.status;
+        return sfx_result::success;
+    }
+    if(continuous(msg.status,msg.data[0])) {
+        for(size_t i = m_continuous_size;i>0;--i) {
+            short_message& waiting = m_continuous[i-1];
+            if(same_target(msg.status,msg.data[0],&waiting.status)) {
+                if(ordered_after(msg.status,waiting.order)) {
+                    // the old value has to go out before what followed
+                    // it, so this one waits behind that instead
+                    break;
+                }
+                waiting.data[1]=msg.data[1];
+                if((msg.status&0xF0)!=0xA0 && (msg.status&0xF0)!=0xB0) {
+                    waiting.data[0]=msg.data[0];
+                }
+                ++m_thinned;
+                return sfx_result::success;
+            }
+        }
+        if(pending()==0 && m_output->send(message)==sfx_result::success) {
+            return sfx_result::success;
+        }
+        if(m_continuous_size==continuous_capacity) {
+            ++m_overruns;
+            return sfx_result::device_error;
+        }
+        m_continuous[m_continuous_size++]=msg;
+        ++m_order;
+        return sfx_result::success;
+    }
+    if(m_realtime_size==0 && m_ordered_size==0 && !continuous_before(msg.status) &&
+            m_output->send(message)==sfx_result::success) {
+        return sfx_result::success;
+    }
+    if(m_ordered_size==ordered_capacity) {
+        ++m_overruns;
+        return sfx_result::device_error;
+    }
+    m_ordered[m_ordered_size++]=msg;
+    ++m_order;
+    return sfx_result::success;
+}
+sfx_result midi_scheduler::flush() {
+    if(m_output==nullptr) {
+        return sfx_result::invalid_argument;
+    }
+    // a refusal just means the rest waits for the next pass
+    drain();
+    return m_output->flush();
+}
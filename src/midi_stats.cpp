@@ -0,0 +1,339 @@
+#include "midi_stats.hpp"
+#include <stdio.h>
+#include <esp_timer.h>
+using namespace sfx;
+// lateness and latency are bucketed in quarter milliseconds
+constexpr static const int32_t time_bin_width = 250;
+// bus waits are bounded by a display chunk, so use finer buckets
+constexpr static const int32_t bus_bin_width = 25;
+static bool write_bytes(stream& stm, const void* data, size_t size) {
+    return size==stm.write((const uint8_t*)data,size);
+}
+template<typename T>
+static bool write_value(stream& stm, T value) {
+    // little endian on the wire regardless of host
+    uint8_t buf[sizeof(T)];
+    for(size_t i = 0;i<sizeof(T);++i) {
+        buf[i]=uint8_t(uint64_t(value)>>(i*8));
+    }
+    return write_bytes(stm,buf,sizeof(T));
+}
+static bool write_line(stream& stm, const char* text) {
+    return write_bytes(stm,text,strlen(text));
+}
+midi_histogram::midi_histogram() {
+    initialize(0,1);
+}
+void midi_histogram::initialize(int32_t low, int32_t width) {
+    m_low = low;
+    m_width = width<1?1:width;
+    clear();
+}
+void midi_histogram::clear() {
+    memset(m_counts,0,sizeof(m_counts));
+    m_position = 0;
+    m_size = 0;
+    m_total = 0;
+    m_sum = 0;
+}
+size_t midi_histogram::bin(int32_t value) const {
+    if(value<m_low) {
+        return 0;
+    }
+    size_t result = (size_t)((value-m_low)/m_width)+1;
+    if(result>bins) {
+        return bins+1;
+    }
+    return result;
+}
+void midi_histogram::add(int32_t value) {
+    if(m_size==window) {
+        // age out the oldest sample
+        --m_counts[bin(m_samples[m_position])];
+        m_sum-=m_samples[m_position];
+    } else {
+        ++m_size;
+    }
+    m_samples[m_position]=value;
+    ++m_counts[bin(value)];
+    if(++m_position==window) {
+        m_position = 0;
+    }
+    ++m_total;
+    m_sum+=value;
+}
+int32_t midi_histogram::min() const {
+    // only scanned when reporting, so add() stays cheap
+    int32_t result = m_size?m_samples[0]:0;
+    for(size_t i = 1;i<m_size;++i) {
+        if(m_samples[i]<result) {
+            result = m_samples[i];
+        }
+    }
+    return result;
+}
+int32_t midi_histogram::max() const {
+    int32_t result = m_size?m_samples[0]:0;
+    for(size_t i = 1;i<m_size;++i) {
+        if(m_samples[i]>result) {
+            result = m_samples[i];
+        }
+    }
+    return result;
+}
+sfx_result midi_histogram::write_text(stream& stream, const char* name) const {
+    char buf[96];
+    snprintf(buf,sizeof(buf),"%s: n=%u/%u min=%d max=%d mean=%d bins=%d+%d*i\r\n",
+        name,(unsigned)m_size,(unsigned)m_total,(int)min(),(int)max(),(int)mean(),(int)m_low,(int)m_width);
+    if(!write_line(stream,buf)) {
+        return sfx_result::io_error;
+    }
+    for(size_t i = 0;i<bins+2;++i) {
+        snprintf(buf,sizeof(buf),i==0?" %u |":(i==bins+1?"| %u\r\n":" %u"),(unsigned)m_counts[i]);
+        if(!write_line(stream,buf)) {
+            return sfx_result::io_error;
+        }
+    }
+    return sfx_result::success;
+}
+sfx_result midi_histogram::write_binary(stream& stream) const {
+    if(!write_value(stream,m_low) ||
+            !write_value(stream,m_width) ||
+            !write_value(stream,m_total) ||
+            !write_value(stream,(uint16_t)m_size) ||
+            !write_value(stream,min()) ||
+            !write_value(stream,max()) ||
+            !write_value(stream,mean())) {
+        return sfx_result::io_error;
+    }
+    for(size_t i = 0;i<bins+2;++i) {
+        if(!write_value(stream,m_counts[i])) {
+            return sfx_result::io_error;
+        }
+    }
+    return sfx_result::success;
+}
+midi_stats::midi_stats(midi_stats&& rhs) {
+    m_offset_ticks = rhs.m_offset_ticks;
+    m_offset_usecs = rhs.m_offset_usecs;
+    m_lateness = rhs.m_lateness;
+    m_latency = rhs.m_latency;
+    m_bus_wait = rhs.m_bus_wait;
+    m_early = rhs.m_early;
+    m_exact = rhs.m_exact;
+    m_late = rhs.m_late;
+    m_tracks = rhs.m_tracks;
+    rhs.m_tracks = nullptr;
+    m_tracks_size = rhs.m_tracks_size;
+    rhs.m_tracks_size = 0;
+    m_deallocator = rhs.m_deallocator;
+    rhs.m_deallocator = nullptr;
+}
+midi_stats& midi_stats::operator=(midi_stats&& rhs) {
+    deallocate();
+    m_offset_ticks = rhs.m_offset_ticks;
+    m_offset_usecs = rhs.m_offset_usecs;
+    m_lateness = rhs.m_lateness;
+    m_latency = rhs.m_latency;
+    m_bus_wait = rhs.m_bus_wait;
+    m_early = rhs.m_early;
+    m_exact = rhs.m_exact;
+    m_late = rhs.m_late;
+    m_tracks = rhs.m_tracks;
+    rhs.m_tracks = nullptr;
+    m_tracks_size = rhs.m_tracks_size;
+    rhs.m_tracks_size = 0;
+    m_deallocator = rhs.m_deallocator;
+    rhs.m_deallocator = nullptr;
+    return *this;
+}
+void midi_stats::deallocate() {
+    if(m_deallocator!=nullptr) {
+        if(m_tracks!=nullptr) {
+            m_deallocator(m_tracks);
+            m_tracks = nullptr;
+            m_tracks_size = 0;
+        }
+    }
+}
+uint32_t midi_stats::now() {
+    return (uint32_t)esp_timer_get_time();
+}
+sfx_result midi_stats::create(size_t tracks_count, int32_t tick_span, int32_t usec_span, midi_stats* out_stats, void*(*allocator)(size_t),void(*deallocator)(void*)) {
+    if(out_stats==nullptr || allocator==nullptr || deallocator==nullptr || tick_span<1 || usec_span<1) {
+        return sfx_result::invalid_argument;
+    }
+    track_latency* tracks = (track_latency*)allocator(sizeof(track_latency)*tracks_count);
+    if(tracks==nullptr) {
+        return sfx_result::out_of_memory;
+    }
+    out_stats->deallocate();
+    out_stats->m_tracks = tracks;
+    out_stats->m_tracks_size = tracks_count;
+    out_stats->m_deallocator = deallocator;
+    const int32_t bins = (int32_t)midi_histogram::bins;
+    out_stats->m_offset_ticks.initialize(-tick_span,(tick_span*2+bins-1)/bins);
+    out_stats->m_offset_usecs.initialize(-usec_span,(usec_span*2+bins-1)/bins);
+    out_stats->m_lateness.initialize(0,time_bin_width);
+    out_stats->m_latency.initialize(0,time_bin_width);
+    out_stats->m_bus_wait.initialize(0,bus_bin_width);
+    out_stats->clear();
+    return sfx_result::success;
+}
+void midi_stats::hit(int32_t offset_ticks, int32_t offset_usecs) {
+    m_offset_ticks.add(offset_ticks);
+    m_offset_usecs.add(offset_usecs);
+    if(offset_ticks<0) {
+        ++m_early;
+    } else if(offset_ticks>0) {
+        ++m_late;
+    } else {
+        ++m_exact;
+    }
+}
+void midi_stats::key(size_t index, uint32_t timestamp) {
+    if(index>=m_tracks_size) {
+        return;
+    }
+    // zero means nothing pending
+    m_tracks[index].pending = timestamp?timestamp:1;
+}
+void midi_stats::note(size_t index, uint32_t timestamp) {
+    if(index>=m_tracks_size) {
+        return;
+    }
+    track_latency& t = m_tracks[index];
+    if(!t.pending) {
+        return;
+    }
+    const uint32_t usecs = timestamp-t.pending;
+    t.pending = 0;
+    t.last = usecs;
+    if(t.count==0 || usecs<t.min) {
+        t.min = usecs;
+    }
+    if(t.count==0 || usecs>t.max) {
+        t.max = usecs;
+    }
+    ++t.count;
+    t.sum+=usecs;
+    m_latency.add((int32_t)usecs);
+}
+void midi_stats::lateness(uint32_t usecs) {
+    m_lateness.add((int32_t)usecs);
+}
+void midi_stats::bus_wait(uint32_t usecs) {
+    m_bus_wait.add((int32_t)usecs);
+}
+void midi_stats::clear() {
+    m_offset_ticks.clear();
+    m_offset_usecs.clear();
+    m_lateness.clear();
+    m_latency.clear();
+    m_bus_wait.clear();
+    m_early = 0;
+    m_exact = 0;
+    m_late = 0;
+    if(m_tracks!=nullptr) {
+        memset(m_tracks,0,sizeof(track_latency)*m_tracks_size);
+    }
+}
+sfx_result midi_stats::copy(const midi_stats& rhs) {
+    if(m_tracks_size!=rhs.m_tracks_size) {
+        return sfx_result::invalid_argument;
+    }
+    m_offset_ticks = rhs.m_offset_ticks;
+    m_offset_usecs = rhs.m_offset_usecs;
+    m_lateness = rhs.m_lateness;
+    m_latency = rhs.m_latency;
+    m_bus_wait = rhs.m_bus_wait;
+    m_early = rhs.m_early;
+    m_exact = rhs.m_exact;
+    m_late = rhs.m_late;
+    if(m_tracks!=nullptr) {
+        memcpy(m_tracks,rhs.m_tracks,sizeof(track_latency)*m_tracks_size);
+    }
+    return sfx_result::success;
+}
+sfx_result midi_stats::write_text(stream& stream) const {
+    char buf[96];
+    snprintf(buf,sizeof(buf),"hits: early=%u exact=%u late=%u\r\n",
+        (unsigned)m_early,(unsigned)m_exact,(unsigned)m_late);
+    if(!write_line(stream,buf)) {
+        return sfx_result::io_error;
+    }
+    sfx_result r = m_offset_ticks.write_text(stream,"offset ticks");
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_offset_usecs.write_text(stream,"offset us");
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_lateness.write_text(stream,"lateness us");
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_latency.write_text(stream,"latency us");
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_bus_wait.write_text(stream,"bus wait us");
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    for(size_t i = 0;i<m_tracks_size;++i) {
+        const track_latency& t = m_tracks[i];
+        if(t.count==0) {
+            continue;
+        }
+        snprintf(buf,sizeof(buf),"track %d latency us: n=%u last=%u min=%u max=%u mean=%u\r\n",
+            (int)i,(unsigned)t.count,(unsigned)t.last,(unsigned)t.min,(unsigned)t.max,(unsigned)(t.sum/t.count));
+        if(!write_line(stream,buf)) {
+            return sfx_result::io_error;
+        }
+    }
+    return sfx_result::success;
+}
+sfx_result midi_stats::write_binary(stream& stream) const {
+    // "PST" followed by the format version
+    static const uint8_t header[] = {'P','S','T',3};
+    if(!write_bytes(stream,header,sizeof(header)) ||
+            !write_value(stream,(uint8_t)midi_histogram::bins) ||
+            !write_value(stream,(uint16_t)m_tracks_size) ||
+            !write_value(stream,m_early) ||
+            !write_value(stream,m_exact) ||
+            !write_value(stream,m_late)) {
+        return sfx_result::io_error;
+    }
+    sfx_result r = m_offset_ticks.write_binary(stream);
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_offset_usecs.write_binary(stream);
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_lateness.write_binary(stream);
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_latency.write_binary(stream);
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    r = m_bus_wait.write_binary(stream);
+    if(r!=sfx_result::success) {
+        return r;
+    }
+    for(size_t i = 0;i<m_tracks_size;++i) {
+        const track_latency& t = m_tracks[i];
+        if(!write_value(stream,t.count) ||
+                !write_value(stream,t.min) ||
+                !write_value(stream,t.max) ||
+                !write_value(stream,(uint32_t)(t.count?t.sum/t.count:0))) {
+            return sfx_result::io_error;
+        }
+    }
+    return sfx_result::success;
+}
@@ -1,56 +1,82 @@
 #include "note_tracker.hpp"
 #include <string.h>
 note_tracker::note_tracker() {
-    memset(m_notes,0,16*(128/8));
+    clear();
+}
+void note_tracker::clear() {
+    memset(m_notes,0,sizeof(m_notes));
+}
+void note_tracker::set(uint8_t channel, uint8_t note) {
+    m_notes[channel&15][(note>>6)&1]|=uint64_t(1)<<(note&63);
+}
+void note_tracker::reset(uint8_t channel, uint8_t note) {
+    m_notes[channel&15][(note>>6)&1]&=~(uint64_t(1)<<(note&63));
+}
+size_t note_tracker::count(uint8_t channel) const {
+    const uint64_t* words = m_notes[channel&15];
+    return __builtin_popcountll(words[0])+__builtin_popcountll(words[1]);
 }
 void note_tracker::process(const sfx::midi_message& message) {
     sfx::midi_message_type t = message.type();
     if(t==sfx::midi_message_type::note_off || 
             (t==sfx::midi_message_type::note_on &&
                     message.lsb()==0)) {
-        uint8_t c = message.channel();
-        uint8_t n = message.msb();
-        if(n<64) {
-            const uint64_t mask = uint64_t(~(1<<n));    
-            m_notes[c].low&=mask;
-        } else {
-            const uint64_t mask = uint64_t(~(1<<(n-64)));
-            m_notes[c].high&=mask;
-        }
+        reset(message.channel(),message.msb());
     } else if(t==sfx::midi_message_type::note_on) {
-        uint8_t c = message.channel();
-        uint8_t n = message.msb();
-        if(n<64) {
-            const uint64_t set = uint64_t(1<<n);    
-            m_notes[c].low|=set;
-        } else {
-            const uint64_t set = uint64_t(1<<(n-64));    
-            m_notes[c].high|=set;
-        }
+        set(message.channel(),message.msb());
     }
 }
-void note_tracker::send_off(sfx::midi_output& output) {
+sfx::sfx_result note_tracker::send_off(midi_bulk_output& output, size_t all_notes_off_threshold, uint16_t all_notes_off_channels) {
+    sfx::midi_message batch[batch_size];
+    size_t size = 0;
+    sfx::sfx_result result = sfx::sfx_result::success;
     for(int i = 0;i<16;++i) {
-        for(int j=0;j<64;++j) {
-            const uint64_t mask = uint64_t(1<<j);
-            if(m_notes[i].low&mask) {
-                sfx::midi_message msg;
-                msg.status = uint8_t(uint8_t(sfx::midi_message_type::note_off)|uint8_t(i));
-                msg.msb(j);
-                msg.lsb(0);
-                output.send(msg);
+        uint64_t* words = m_notes[i];
+        if(0==(words[0]|words[1])) {
+            continue;
+        }
+        if(all_notes_off_threshold!=0 && 
+                0!=(all_notes_off_channels&(1<<i)) && 
+                count(i)>=all_notes_off_threshold) {
+            sfx::midi_message& msg = batch[size++];
+            msg.status = uint8_t(uint8_t(sfx::midi_message_type::control_change)|uint8_t(i));
+            msg.msb(123);
+            msg.lsb(0);
+        } else {
+            for(int w = 0;w<2;++w) {
+                uint64_t bits = words[w];
+                while(bits) {
+                    const int j = __builtin_ctzll(bits);
+                    bits&=bits-1;
+                    sfx::midi_message& msg = batch[size++];
+                    msg.status = uint8_t(uint8_t(sfx::midi_message_type::note_off)|uint8_t(i));
+                    msg.msb(uint8_t(j+(w<<6)));
+                    msg.lsb(0);
+                    if(size==batch_size) {
+                        sfx::sfx_result r = output.send(batch,size);
+                        if(r!=sfx::sfx_result::success) {
+                            result = r;
+                        }
+                        size = 0;
+                    }
+                }
             }
         }
-        for(int j=0;j<64;++j) {
-            const uint64_t mask = uint64_t(1<<j);
-            if(m_notes[i].high&mask) {
-                sfx::midi_message msg;
-                msg.status = uint8_t(uint8_t(sfx::midi_message_type::note_off)|uint8_t(i));
-                msg.msb(j+64);
-                msg.lsb(0);
-                output.send(msg);
+        words[0]=0;
+        words[1]=0;
+        if(size==batch_size) {
+            sfx::sfx_result r = output.send(batch,size);
+            if(r!=sfx::sfx_result::success) {
+                result = r;
             }
+            size = 0;
         }
     }
-    memset(m_notes,0,sizeof(m_notes));
-}
\ No newline at end of file
+    if(size) {
+        sfx::sfx_result r = output.send(batch,size);
+        if(r!=sfx::sfx_result::success) {
+            result = r;
+        }
+    }
+    return result;
+}
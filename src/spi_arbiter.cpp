@@ -0,0 +1,30 @@
+#include "spi_arbiter.hpp"
+#include <esp_timer.h>
+spi_arbiter::spi_arbiter() : m_critical_waiting(0) {
+    m_mutex = xSemaphoreCreateMutexStatic(&m_mutex_buffer);
+}
+uint32_t spi_arbiter::critical_acquire() {
+    if(pdTRUE==xSemaphoreTake(m_mutex,0)) {
+        return 0;
+    }
+    __atomic_add_fetch(&m_critical_waiting,1,__ATOMIC_SEQ_CST);
+    const int64_t start = esp_timer_get_time();
+    // the mutex lends our priority to the bulk side until it lets go
+    xSemaphoreTake(m_mutex,portMAX_DELAY);
+    __atomic_sub_fetch(&m_critical_waiting,1,__ATOMIC_SEQ_CST);
+    return (uint32_t)(esp_timer_get_time()-start);
+}
+void spi_arbiter::critical_release() {
+    xSemaphoreGive(m_mutex);
+}
+void spi_arbiter::bulk_acquire() {
+    // a give doesn't hand the mutex over, so don't snatch it back
+    // from under a critical waiter between chunks
+    while(__atomic_load_n(&m_critical_waiting,__ATOMIC_SEQ_CST)) {
+        taskYIELD();
+    }
+    xSemaphoreTake(m_mutex,portMAX_DELAY);
+}
+void spi_arbiter::bulk_release() {
+    xSemaphoreGive(m_mutex);
+}
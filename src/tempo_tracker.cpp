@@ -0,0 +1,111 @@
+#include "tempo_tracker.hpp"
+tempo_tracker::tempo_tracker() {
+    clear();
+}
+void tempo_tracker::clear() {
+    m_taps.clear();
+    m_onsets.clear();
+    m_microtempo = 0;
+}
+void tempo_tracker::intervals::clear() {
+    last = 0;
+    position = 0;
+    size = 0;
+}
+void tempo_tracker::intervals::add(uint32_t interval) {
+    values[position]=interval;
+    if(++position==history) {
+        position = 0;
+    }
+    if(size<history) {
+        ++size;
+    }
+}
+uint32_t tempo_tracker::intervals::median() const {
+    // insertion sort a copy. it's at most 8 entries
+    uint32_t sorted[history];
+    for(size_t i = 0;i<size;++i) {
+        uint32_t v = values[i];
+        size_t j = i;
+        while(j>0 && sorted[j-1]>v) {
+            sorted[j]=sorted[j-1];
+            --j;
+        }
+        sorted[j]=v;
+    }
+    return sorted[size/2];
+}
+bool tempo_tracker::tap(uint32_t timestamp) {
+    const uint32_t last = m_taps.last;
+    m_taps.last = timestamp?timestamp:1;
+    if(last==0) {
+        return false;
+    }
+    const uint32_t interval = timestamp-last;
+    if(interval<debounce) {
+        m_taps.last = last;
+        return false;
+    }
+    if(interval>timeout) {
+        // start over
+        m_taps.position = 0;
+        m_taps.size = 0;
+        return false;
+    }
+    m_taps.add(interval);
+    // whatever the onsets were saying gives way to the taps
+    m_onsets.clear();
+    const int32_t mt = (int32_t)m_taps.median();
+    if(mt==m_microtempo) {
+        return false;
+    }
+    m_microtempo = mt;
+    return true;
+}
+bool tempo_tracker::onset(uint32_t timestamp) {
+    const uint32_t last = m_onsets.last;
+    if(last!=0 && timestamp-last<debounce) {
+        return false;
+    }
+    m_onsets.last = timestamp?timestamp:1;
+    if(last==0) {
+        return false;
+    }
+    uint32_t interval = timestamp-last;
+    if(interval>timeout) {
+        return false;
+    }
+    // fold the interval by octaves into the quarter note range,
+    // or toward the current estimate if we have one
+    uint32_t lo = min_interval, hi = max_interval;
+    if(m_microtempo!=0) {
+        lo = (uint32_t)m_microtempo*3/4;
+        hi = (uint32_t)m_microtempo*3/2;
+    }
+    while(interval<lo) {
+        interval<<=1;
+    }
+    while(interval>hi) {
+        interval>>=1;
+    }
+    if(interval<min_interval || interval>max_interval) {
+        return false;
+    }
+    m_onsets.add(interval);
+    if(m_onsets.size<3) {
+        return false;
+    }
+    const int32_t target = (int32_t)m_onsets.median();
+    int32_t mt;
+    if(m_microtempo==0) {
+        mt = target;
+    } else {
+        // one pole low pass with a gain of 1/4
+        mt = m_microtempo+((target-m_microtempo)>>2);
+    }
+    if(mt==m_microtempo) {
+        return false;
+    }
+    m_microtempo = mt;
+    return true;
+}
@@ -0,0 +1,92 @@
+#include "track_transform.hpp"
+#include <math.h>
+using namespace sfx;
+track_transform::track_transform() : m_dynamics(127) {
+    set(defaults());
+}
+track_transform::settings track_transform::defaults() {
+    settings result;
+    result.channel = -1;
+    result.transpose = 0;
+    result.low_note = 0;
+    result.high_note = 127;
+    result.velocity_scale = 100;
+    result.velocity_curve = 1.0f;
+    return result;
+}
+void track_transform::set(const settings& value) {
+    m_settings = value;
+    compile();
+}
+void track_transform::dynamics(uint8_t velocity) {
+    if(velocity>127) {
+        velocity = 127;
+    }
+    if(velocity==m_dynamics) {
+        return;
+    }
+    m_dynamics = velocity;
+    compile_velocities();
+}
+void track_transform::compile_velocities() {
+    const settings& s = m_settings;
+    m_identity = s.channel<0 && s.transpose==0 && s.low_note==0 && s.high_note>=127 &&
+        s.velocity_scale==100 && s.velocity_curve==1.0f && m_dynamics==127;
+    // integer only, since this runs on every trigger
+    m_velocities[0]=0;
+    for(int v = 1;v<128;++v) {
+        const int r = (m_curve[v]*m_dynamics+63)/127;
+        m_velocities[v]=uint8_t(r<1?1:r);
+    }
+}
+void track_transform::compile() {
+    const settings& s = m_settings;
+    for(int c = 0;c<16;++c) {
+        m_channels[c]=s.channel<0?uint8_t(c):uint8_t(s.channel&0x0F);
+    }
+    for(int n = 0;n<128;++n) {
+        const int t = n+s.transpose;
+        m_notes[n]=(t<s.low_note || t>s.high_note || t<0 || t>127)?0xFF:uint8_t(t);
+    }
+    const float curve = s.velocity_curve>0?s.velocity_curve:1.0f;
+    m_curve[0]=0;
+    for(int v = 1;v<128;++v) {
+        float f = v/127.0f;
+        if(curve!=1.0f) {
+            f = powf(f,curve);
+        }
+        int r = (int)lroundf(f*127.0f*s.velocity_scale/100.0f);
+        // a note on must never turn into a note off
+        m_curve[v]=uint8_t(r<1?1:(r>127?127:r));
+    }
+    compile_velocities();
+}
+const midi_message* track_transform::shape(const midi_message& in, midi_message* out) const {
+    if(m_identity || in.status<0x80 || in.status>=0xF0) {
+        return &in;
+    }
+    const uint8_t type = in.status&0xF0;
+    out->status = uint8_t(type|m_channels[in.status&0x0F]);
+    switch(type) {
+        case 0x80: // note off
+        case 0x90: // note on
+        case 0xA0: { // polyphonic pressure
+            const uint8_t n = m_notes[in.msb()&0x7F];
+            if(n==0xFF) {
+                return nullptr;
+            }
+            out->msb(n);
+            out->lsb(type==0x90?m_velocities[in.lsb()&0x7F]:in.lsb());
+            break;
+        }
+        case 0xC0: // program change
+        case 0xD0: // channel pressure
+            out->value8 = in.value8;
+            break;
+        default:
+            out->msb(in.msb());
+            out->lsb(in.lsb());
+            break;
+    }
+    return out;
+}
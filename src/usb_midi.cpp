@@ -0,0 +1,104 @@
+#include "usb_midi.hpp"
+static const uint8_t usb_midi_cin_sizes[] = {0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1};
+usb_midi_decoder::usb_midi_decoder() {
+    reset();
+}
+void usb_midi_decoder::reset() {
+    m_sysex_size = 0;
+    m_in_sysex = false;
+}
+size_t usb_midi_decoder::cin_size(uint8_t cin) {
+    return usb_midi_cin_sizes[cin&0x0F];
+}
+bool usb_midi_decoder::decode(const uint8_t* packet, usb_midi_message* out_message) {
+    const uint8_t cin = packet[0]&0x0F;
+    out_message->cable = packet[0]>>4;
+    switch(cin) {
+        case 0x0:
+        case 0x1:
+            // reserved, and the zero padding some devices send
+            return false;
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        case 0x7: {
+            if(cin==0x5 && !m_in_sysex && packet[1]!=0xF0) {
+                if(packet[1]==0xF7) {
+                    // a stray end of sysex
+                    return false;
+                }
+                // single byte system common
+                out_message->data = packet+1;
+                out_message->size = 1;
+                return true;
+            }
+            const size_t sz = cin==0x4?3:cin-0x4;
+            if(packet[1]==0xF0) {
+                // a new sysex implicitly ends an unterminated one
+                m_sysex_size = 0;
+                m_in_sysex = true;
+            } else if(!m_in_sysex) {
+                return false;
+            }
+            for(size_t i = 0;i<sz;++i) {
+                m_sysex[m_sysex_size++]=packet[1+i];
+            }
+            if(cin!=0x4) {
+                m_in_sysex = false;
+            } else if(m_sysex_size+3<=max_sysex) {
+                return false;
+            }
+            // complete, or full enough to hand out a piece
+            out_message->data = m_sysex;
+            out_message->size = m_sysex_size;
+            m_sysex_size = 0;
+            return true;
+        }
+        default:
+            out_message->data = packet+1;
+            out_message->size = usb_midi_cin_sizes[cin];
+            return true;
+    }
+}
+uint8_t usb_midi_encoder::cin(uint8_t status, size_t size) {
+    if(status>=0x80 && status<0xF0) {
+        return status>>4;
+    }
+    switch(size) {
+        case 1:
+            // real time goes as a single byte, the rest as system common
+            return status>=0xF8?0xF:0x5;
+        case 2:
+            return 0x2;
+        case 3:
+            return 0x3;
+        default:
+            return 0;
+    }
+}
+static size_t sysex_wire_size(const uint8_t* data, size_t size) {
+    if(data==nullptr) {
+        size = 0;
+    }
+    return 1+size+((size && data[size-1]==0xF7)?0:1);
+}
+size_t usb_midi_encoder::sysex_packets(const uint8_t* data, size_t size) {
+    return (sysex_wire_size(data,size)+2)/3;
+}
+void usb_midi_encoder::sysex_packet(uint8_t status, const uint8_t* data, size_t size, size_t index, uint8_t* out_packet) {
+    const size_t total = sysex_wire_size(data,size);
+    if(data==nullptr) {
+        size = 0;
+    }
+    size_t i = index*3;
+    size_t n = 0;
+    out_packet[1]=0;
+    out_packet[2]=0;
+    out_packet[3]=0;
+    while(n<3 && i<total) {
+        out_packet[1+n++]=i==0?status:(i<=size?data[i-1]:0xF7);
+        ++i;
+    }
+    // 4 continues it, 5, 6 and 7 end it with 1, 2 or 3 bytes
+    out_packet[0]=i<total?0x4:uint8_t(0x4+n);
+}
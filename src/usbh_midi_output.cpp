@@ -0,0 +1,48 @@
+#include "usbh_midi_output.hpp"
+#include "usb_midi.hpp"
+#include <string.h>
+using namespace sfx;
+usbh_midi_output::usbh_midi_output() : m_overruns(0) {
+}
+sfx_result usbh_midi_output::send(const midi_message& message) {
+    if(message.type()==midi_message_type::meta_event && 
+            (message.meta.type!=0 || message.meta.data!=nullptr)) {
+        return sfx_result::success;
+    }
+    packet p;
+    if(message.type()==midi_message_type::system_exclusive) {
+        const size_t count = usb_midi_encoder::sysex_packets(message.sysex.data,message.sysex.size);
+        // all of it or none of it, so the device never sees half a dump
+        if(capacity-m_packets.size()<count) {
+            ++m_overruns;
+            return sfx_result::device_error;
+        }
+        for(size_t i = 0;i<count;++i) {
+            usb_midi_encoder::sysex_packet(message.status,message.sysex.data,message.sysex.size,i,p.data);
+            m_packets.push(p);
+        }
+        return sfx_result::success;
+    }
+    const int ws = message.wire_size();
+    p.data[0] = usb_midi_encoder::cin(message.status,ws);
+    if(p.data[0]==0) {
+        return sfx_result::success;
+    }
+    p.data[1] = message.status;
+    p.data[2] = ws==2?message.value8:(ws==3?message.msb():0);
+    p.data[3] = ws==3?message.lsb():0;
+    if(!m_packets.push(p)) {
+        ++m_overruns;
+        return sfx_result::device_error;
+    }
+    return sfx_result::success;
+}
+size_t usbh_midi_output::take(uint8_t* out_buffer, size_t size) {
+    size_t result = 0;
+    packet p;
+    while(result+4<=size && m_packets.pop(&p)) {
+        memcpy(out_buffer+result,p.data,4);
+        result+=4;
+    }
+    return result;
+}
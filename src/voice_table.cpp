@@ -0,0 +1,111 @@
+#include "voice_table.hpp"
+#include <string.h>
+static uint64_t owner_bit(size_t owner) {
+    return uint64_t(1)<<owner;
+}
+voice_table::voice_table() : m_all_notes_off_threshold(0) {
+    clear();
+}
+void voice_table::clear() {
+    memset(m_index,0,sizeof(m_index));
+    memset(m_voices,0,sizeof(m_voices));
+    memset(m_channel_voices,0,sizeof(m_channel_voices));
+    for(size_t i = 0;i<max_voices;++i) {
+        // hand out the low slots first
+        m_free[i]=uint8_t(max_voices-i-1);
+    }
+    m_free_size = max_voices;
+}
+void voice_table::free_voice(size_t index) {
+    voice& v = m_voices[index];
+    m_index[v.channel][v.note]=0;
+    --m_channel_voices[v.channel];
+    v.owners = 0;
+    v.refs = 0;
+    m_free[m_free_size++]=uint8_t(index);
+}
+bool voice_table::process(size_t owner, const sfx::midi_message& message) {
+    if(owner>=max_owners) {
+        // sharing a bit would let one owner's note off end another's
+        return true;
+    }
+    sfx::midi_message_type t = message.type();
+    if(t==sfx::midi_message_type::note_off ||
+            (t==sfx::midi_message_type::note_on &&
+                    message.lsb()==0)) {
+        const uint8_t c = message.channel();
+        const uint8_t n = message.msb()&0x7F;
+        const uint8_t i = m_index[c][n];
+        if(i==0) {
+            // not something we're tracking
+            return true;
+        }
+        voice& v = m_voices[i-1];
+        const uint64_t bit = owner_bit(owner);
+        if(0==(v.owners&bit)) {
+            // someone else's note
+            return false;
+        }
+        v.owners&=~bit;
+        if(--v.refs==0) {
+            free_voice(i-1);
+            return true;
+        }
+        return false;
+    } else if(t==sfx::midi_message_type::note_on) {
+        const uint8_t c = message.channel();
+        const uint8_t n = message.msb()&0x7F;
+        uint8_t i = m_index[c][n];
+        if(i==0) {
+            if(m_free_size==0) {
+                // out of voices. play it untracked
+                return true;
+            }
+            i = m_free[--m_free_size]+1;
+            m_index[c][n]=i;
+            ++m_channel_voices[c];
+            voice& v = m_voices[i-1];
+            v.channel = c;
+            v.note = n;
+            v.owners = 0;
+            v.refs = 0;
+        }
+        voice& v = m_voices[i-1];
+        const uint64_t bit = owner_bit(owner);
+        if(0==(v.owners&bit)) {
+            v.owners|=bit;
+            ++v.refs;
+        }
+    }
+    return true;
+}
+void voice_table::release(size_t owner, midi_bulk_output* output) {
+    if(owner>=max_owners) {
+        return;
+    }
+    const uint64_t bit = owner_bit(owner);
+    note_tracker offs;
+    bool any = false;
+    for(size_t i = 0;i<max_voices;++i) {
+        voice& v = m_voices[i];
+        if(0==(v.owners&bit)) {
+            continue;
+        }
+        v.owners&=~bit;
+        if(--v.refs==0) {
+            offs.set(v.channel,v.note);
+            any = true;
+            free_voice(i);
+        }
+    }
+    if(any && output!=nullptr) {
+        // only channels with nothing else sounding may be blanket silenced
+        uint16_t idle = 0;
+        for(int c = 0;c<16;++c) {
+            if(m_channel_voices[c]==0) {
+                idle|=(1<<c);
+            }
+        }
+        offs.send_off(*output,m_all_notes_off_threshold,idle);
+    }
+}